@@ -0,0 +1,147 @@
+#pragma once
+
+// 包含必要的头文件 - Include necessary header files
+#include "RecipientDecoding.h"
+#include "client.h"
+#include "seal/seal.h"
+#include <NTL/BasicThreadPool.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <vector>
+using namespace seal;
+
+/**
+ * 多个接收者摘要的批量解码 - Batch decoding of many recipients' digests
+ * 面向替大量用户解码的托管服务：所有摘要共享同一个接收者上下文和批编码器，用户在NTL线程池上按块并行解码，
+ * 每个块有自己的暂存缓冲区（明文、解码槽位、方程组），在多次调用间复用
+ * For custodial services decoding on behalf of many users: all digests share one recipient context and batch encoder, the users are
+ * decoded in parallel chunks on the NTL thread pool, and every chunk has its own scratch buffers (plaintext, decoded slots, equations)
+ * that are reused across calls
+ * 每个用户的摘要在一个线程内解码，因此求解器不再嵌套并行 - Each user's digest is decoded within one thread, so the solver is no longer nested-parallel
+ */
+class BatchRecipientDecoder{
+public:
+    /**
+     * @param context 接收者上下文，见recipientContext - Recipient context, see recipientContext
+     */
+    BatchRecipientDecoder(const SEALContext& context)
+    : context(context), batch_encoder(context), degree(context.first_context_data()->parms().poly_modulus_degree())
+    {}
+
+    /**
+     * 并行解码一批(私钥, 摘要)对 - Decode a batch of (secret key, digest) pairs in parallel
+     * @param results 每个用户的载荷，与recipientDecode相同 - Payloads per user, same as recipientDecode
+     * @param pertinentIndices 每个用户的相关索引映射 - Pertinent indices map per user
+     * @param secret_keys 接收者上下文中的私钥 - Secret keys in the recipient context
+     * @param digests 摘要 - Digests
+     * @param threads 并行的用户块数 - Number of user chunks run in parallel
+     * @return 成功解码的摘要数 - Number of digests decoded successfully
+     */
+    size_t decode(vector<vector<vector<long>>>& results, vector<map<int, int>>& pertinentIndices, const vector<SecretKey>& secret_keys,
+                const vector<RecipientDigest>& digests, const int threads = 1){
+        size_t numOfUsers = digests.size();
+        results.assign(numOfUsers, vector<vector<long>>());
+        pertinentIndices.assign(numOfUsers, map<int, int>());
+        if(secret_keys.size() != numOfUsers){
+            cerr << "Every digest needs its secret key." << endl;
+            return 0;
+        }
+
+        int chunks = max(1, min(threads, int(numOfUsers)));
+        if(scratch.size() < size_t(chunks))
+            scratch.resize(chunks);
+        vector<char> decoded(numOfUsers, 0);
+
+        auto time_start = chrono::high_resolution_clock::now();
+        NTL_EXEC_RANGE(chunks, first, last);
+        for(long chunk = first; chunk < last; chunk++){
+            size_t begin = numOfUsers * chunk / chunks, end = numOfUsers * (chunk + 1) / chunks;
+            for(size_t u = begin; u < end; u++){
+                decoded[u] = decodeOne(results[u], pertinentIndices[u], secret_keys[u], digests[u], scratch[chunk]);
+            }
+        }
+        NTL_EXEC_RANGE_END;
+        auto time_end = chrono::high_resolution_clock::now();
+
+        size_t numOfDecoded = size_t(count(decoded.begin(), decoded.end(), 1));
+        double seconds = chrono::duration<double>(time_end - time_start).count();
+        rate = seconds > 0 ? double(numOfDecoded) / seconds : 0;
+        return numOfDecoded;
+    }
+
+    // 上一批的吞吐量（摘要/秒）- Throughput of the last batch in digests per second
+    double digestsPerSecond() const{
+        return rate;
+    }
+
+private:
+    struct Scratch{
+        Plaintext plain;
+        vector<vector<uint64_t>> decoded;
+        vector<bool> hasHigh;
+        vector<const Ciphertext*> cts;
+        vector<vector<int>> lhs;
+        vector<vector<int>> rhs;
+    };
+
+    // 在一个线程内解码一个摘要，步骤与recipientDecode相同 - Decode one digest within one thread, same steps as recipientDecode
+    bool decodeOne(vector<vector<long>>& result, map<int, int>& pertinentIndices, const SecretKey& secret_key, const RecipientDigest& digest,
+                Scratch& scratch){
+        if(digest.rhs.size() == 0 || !context.get_context_data(digest.rhs.parms_id()))
+            return false;
+
+        // 索引密文在前，rhs在最后 - Index ciphertexts first, rhs last
+        int blockSize = int(16*degree);
+        scratch.cts.clear();
+        if(digest.randomized){
+            scratch.hasHigh.resize(digest.lhsCounter.size());
+            for(size_t i = 0; i < digest.lhsCounter.size(); i++){
+                scratch.hasHigh[i] = digest.lhsRandom[i].size() == 2;
+                scratch.cts.push_back(&digest.lhsCounter[i]);
+                scratch.cts.push_back(scratch.hasHigh[i] ? &digest.lhsRandom[i][0] : nullptr);
+                scratch.cts.push_back(&digest.lhsRandom[i].back());
+            }
+        } else {
+            for(size_t k = 0; k < digest.lhs.size() && int(k)*blockSize < digest.numOfTransactions; k++){
+                scratch.cts.push_back(&digest.lhs[k]);
+            }
+        }
+        scratch.cts.push_back(&digest.rhs);
+
+        Decryptor decryptor(context, secret_key);
+        scratch.decoded.resize(scratch.cts.size());
+        for(size_t i = 0; i < scratch.cts.size(); i++){
+            if(!scratch.cts[i] || scratch.cts[i]->size() == 0)
+                continue;
+            decryptor.decrypt(*scratch.cts[i], scratch.plain);
+            batch_encoder.decode(scratch.plain, scratch.decoded[i]);
+        }
+
+        // 1. 查找相关索引 - Find pertinent indices
+        if(digest.randomized){
+            if(!scanIndexPackRandom(pertinentIndices, scratch.decoded, scratch.hasHigh, degree, digest.indexBase))
+                return false;
+        } else {
+            for(size_t k = 0; k + 1 < scratch.cts.size(); k++){
+                if(scratch.cts[k]->size() == 0)
+                    continue;
+                scanIndexPack(pertinentIndices, scratch.decoded[k], min(blockSize, digest.numOfTransactions - int(k)*blockSize),
+                                digest.indexBase + int(k)*blockSize);
+            }
+        }
+
+        // 2-4. 构建并求解方程 - Form and solve the equations
+        formRhs(scratch.rhs, scratch.decoded.back(), digest.num_of_buckets, digest.payloadSize);
+        formLhsWeights(scratch.lhs, pertinentIndices, digest.num_of_buckets, digest.repetition, digest.seed);
+        result = peelingEquationSolving(scratch.lhs, scratch.rhs, digest.payloadSize, 1);
+        return result.size() == pertinentIndices.size();
+    }
+
+    SEALContext context;
+    BatchEncoder batch_encoder;                         // 所有线程共享 - Shared by all threads
+    size_t degree;
+    vector<Scratch> scratch;                            // 每个块一个 - One per chunk
+    double rate = 0;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+// 包含必要的头文件 - Include necessary header files
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+/**
+ * 可寻址的桶分配 - Seekable bucket assignment
+ * 每条消息的repetition个桶和权重只由(seed, 消息索引)通过以seed为密钥的SipHash-2-4导出，任意索引都能在O(1)时间内得到
+ * The repetition buckets and weights of every message are derived from (seed, message index) alone through SipHash-2-4 keyed by seed,
+ * so any index is available in O(1)
+ * 检测者和接收者因此不需要为整个公告板生成二分图：接收者只导出相关消息的行
+ * Neither the detector nor the recipient has to generate the bipartite graph of the whole board: the recipient only derives the rows of
+ * the pertinent messages
+ */
+
+inline uint64_t rotl64(const uint64_t x, const int b){
+    return (x << b) | (x >> (64 - b));
+}
+
+/**
+ * 16字节消息(m0, m1)的SipHash-2-4 - SipHash-2-4 of the 16-byte message (m0, m1)
+ * @param k0 密钥低64位 - Low 64 bits of the key
+ * @param k1 密钥高64位 - High 64 bits of the key
+ * @param m0 第一个字 - First word
+ * @param m1 第二个字 - Second word
+ * @return 64位输出 - 64-bit output
+ */
+inline uint64_t siphash24(const uint64_t k0, const uint64_t k1, const uint64_t m0, const uint64_t m1){
+    uint64_t v0 = k0 ^ 0x736f6d6570736575ULL;
+    uint64_t v1 = k1 ^ 0x646f72616e646f6dULL;
+    uint64_t v2 = k0 ^ 0x6c7967656e657261ULL;
+    uint64_t v3 = k1 ^ 0x7465646279746573ULL;
+    auto round = [&](){
+        v0 += v1; v1 = rotl64(v1, 13); v1 ^= v0; v0 = rotl64(v0, 32);
+        v2 += v3; v3 = rotl64(v3, 16); v3 ^= v2;
+        v0 += v3; v3 = rotl64(v3, 21); v3 ^= v0;
+        v2 += v1; v1 = rotl64(v1, 17); v1 ^= v2; v2 = rotl64(v2, 32);
+    };
+    const uint64_t blocks[3] = {m0, m1, uint64_t(16) << 56}; // the last block only carries the length
+    for(int b = 0; b < 3; b++){
+        v3 ^= blocks[b];
+        round();
+        round();
+        v0 ^= blocks[b];
+    }
+    v2 ^= 0xff;
+    for(int r = 0; r < 4; r++){
+        round();
+    }
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/**
+ * 导出一条消息的桶和权重 - Derive the buckets and weights of one message
+ * 第c次抽取使用SipHash(seed, index, c)：低32位选桶（重复时重新抽取），高32位给出非零权重
+ * Draw c uses SipHash(seed, index, c): the low 32 bits pick the bucket (drawn again on repeats), the high 32 bits give the non-zero weight
+ * @param buckets 输出桶 - Output buckets
+ * @param weights 输出权重，在[1, 65536]中 - Output weights, in [1, 65536]
+ * @param index 消息索引 - Message index
+ * @param num_of_buckets 桶的数量 - Number of buckets
+ * @param repetition 每条消息的桶数 - Buckets per message
+ * @param seed 种子 - Seed
+ */
+inline void bucketsOf(vector<int>& buckets, vector<int>& weights, const uint64_t index, const int num_of_buckets, const int repetition, const int seed){
+    buckets.assign(repetition, -1);
+    weights.assign(repetition, -1);
+    uint64_t draw = 0;
+    for(int j = 0; j < repetition; j++){
+        while(true){
+            uint64_t h = siphash24(uint64_t(uint32_t(seed)), 0, index, draw++);
+            int temp = int((h & 0xFFFFFFFF) % uint64_t(num_of_buckets));
+            // avoid repeatition
+            if(find(buckets.begin(), buckets.begin() + j, temp) != buckets.begin() + j)
+                continue;
+            buckets[j] = temp;
+            weights[j] = int((h >> 32) % 65536) + 1;
+            break;
+        }
+    }
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+// 包含必要的头文件 - Include necessary header files
+#include "seal/seal.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+using namespace seal;
+using namespace std;
+
+/**
+ * 紧凑摘要格式 - Compact digest format
+ * 摘要降到最后一级后，系数的低位大部分是噪声。解密 round(t/q * (c0 + c1*s)) 能容忍舍入误差，只要总误差小于q/(2t)
+ * Once the digest is at the last level, the low-order bits of its coefficients are mostly noise. Decryption round(t/q * (c0 + c1*s))
+ * tolerates rounding them away as long as the total error stays below q/(2t)
+ * 格式 - Format: 魔数 - magic "OMRC" | 版本 - version (uint32) | parms_id | 多项式个数 - number of polys | 每个多项式舍去的位数 - bits dropped per poly |
+ *      按位打包的系数 - bit-packed coefficients
+ * 舍去低位只在单个素数时进行，多个素数时只做按位打包 - Low bits are only dropped with a single prime left, otherwise coefficients are only bit-packed
+ * 噪声预算必须来自持有私钥的一方的测量（见measuredNoiseBudget），没有测量时传0，只做按位打包
+ * The noise budget must be measured by the party holding the secret key (see measuredNoiseBudget); pass 0 without a measurement,
+ * which only bit-packs
+ */
+
+const char compactDigestMagic[4] = {'O', 'M', 'R', 'C'};
+const uint32_t compactDigestVersion = 1;
+
+/**
+ * 持有私钥的一方测量的噪声预算 - Noise budget measured by the party holding the secret key
+ * 检测者没有私钥，只能使用接收者报告的测量值 - The detector has no secret key and can only use a measurement reported by the recipient
+ * @param decryptor 解密器 - Decryptor
+ * @param context SEAL上下文 - SEAL context
+ * @param digest 摘要，NTT形式会被先转换 - Digest, converted out of NTT form first if needed
+ * @return 噪声预算（位）- Noise budget in bits
+ */
+int measuredNoiseBudget(Decryptor& decryptor, const SEALContext& context, const Ciphertext& digest){
+    if(!digest.is_ntt_form())
+        return decryptor.invariant_noise_budget(digest);
+    Ciphertext ct = digest;
+    Evaluator evaluator(context);
+    evaluator.transform_from_ntt_inplace(ct);
+    return decryptor.invariant_noise_budget(ct);
+}
+
+/**
+ * 根据剩余噪声预算选择可以安全舍去的位数 - Choose how many low bits can be safely dropped from the remaining noise budget
+ * 一半的剩余余量分给c0的舍入，另一半分给c1*s的舍入（s为三元，取6个标准差）
+ * Half of the remaining slack goes to rounding c0, the other half to rounding c1*s (s ternary, 6 standard deviations)
+ * @param context SEAL上下文 - SEAL context
+ * @param parms_id 摘要的参数ID - parms_id of the digest
+ * @param noiseBudget 摘要的噪声预算（位）- Noise budget of the digest in bits
+ * @return 每个多项式舍去的位数 {c0, c1} - Bits dropped per poly {c0, c1}
+ */
+vector<int> digestTruncationBits(const SEALContext& context, const parms_id_type& parms_id, const double noiseBudget){
+    auto context_data = context.get_context_data(parms_id);
+    auto& parms = context_data->parms();
+    vector<int> bits = {0, 0};
+    if(parms.coeff_modulus().size() != 1 || noiseBudget <= 0){
+        return bits;
+    }
+    double modulusBits = log2(double(parms.coeff_modulus()[0].value()));
+    double plainBits = log2(double(parms.plain_modulus().value()));
+    double slack = 0.5 - pow(2.0, -noiseBudget - 1);                    // invariant noise left before decryption fails
+    double allowed = modulusBits - plainBits + log2(slack) - 1;          // log2 of the error allowed for each of c0 and c1*s
+    double sDeviations = log2(6 * sqrt(2.0 * parms.poly_modulus_degree() / 3));
+
+    bits[0] = max(0, int(floor(allowed)));
+    bits[1] = max(0, int(floor(allowed - sDeviations)));
+    for(auto& b : bits){
+        b = min(b, parms.coeff_modulus()[0].bit_count() - 1);
+    }
+    return bits;
+}
+
+/**
+ * 以紧凑格式保存摘要 - Save a digest in the compact format
+ * @param digest 摘要，NTT形式会被先转换 - Digest, converted out of NTT form first if needed
+ * @param context SEAL上下文 - SEAL context
+ * @param noiseBudget 摘要的噪声预算（位）- Noise budget of the digest in bits
+ * @param stream 输出流 - Output stream
+ * @return 写入的字节数 - Number of bytes written
+ */
+streamoff saveCompactDigest(const Ciphertext& digest, const SEALContext& context, const double noiseBudget, ostream& stream){
+    Ciphertext ct = digest;
+    if(ct.is_ntt_form()){
+        Evaluator evaluator(context);
+        evaluator.transform_from_ntt_inplace(ct);
+    }
+    auto& coeff_modulus = context.get_context_data(ct.parms_id())->parms().coeff_modulus();
+    size_t degree = ct.poly_modulus_degree();
+    vector<int> dropped = digestTruncationBits(context, ct.parms_id(), noiseBudget);
+    dropped.resize(ct.size(), dropped.back());
+
+    streamoff written = 0;
+    stream.write(compactDigestMagic, sizeof(compactDigestMagic));
+    stream.write(reinterpret_cast<const char*>(&compactDigestVersion), sizeof(compactDigestVersion));
+    parms_id_type parms_id = ct.parms_id();
+    stream.write(reinterpret_cast<const char*>(parms_id.data()), sizeof(parms_id_type));
+    uint32_t size = uint32_t(ct.size());
+    stream.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    written += sizeof(compactDigestMagic) + sizeof(compactDigestVersion) + sizeof(parms_id_type) + sizeof(size);
+    for(size_t p = 0; p < ct.size(); p++){
+        uint8_t b = uint8_t(dropped[p]);
+        stream.write(reinterpret_cast<const char*>(&b), 1);
+        written += 1;
+    }
+
+    uint64_t buffer = 0;
+    int buffered = 0;
+    for(size_t p = 0; p < ct.size(); p++){
+        const uint64_t* poly = ct.data(p);
+        for(size_t r = 0; r < coeff_modulus.size(); r++){
+            uint64_t q = coeff_modulus[r].value();
+            int k = dropped[p];
+            int width = coeff_modulus[r].bit_count() - k;
+            for(size_t c = r*degree; c < (r+1)*degree; c++){
+                // round to the nearest multiple of 2^k, rounding up to q wraps around to 0
+                uint64_t rounded = k ? (poly[c] + (uint64_t(1) << (k-1))) >> k : poly[c];
+                if((rounded << k) >= q)
+                    rounded = 0;
+                buffer |= rounded << buffered;
+                buffered += width;
+                if(buffered >= 64){
+                    stream.write(reinterpret_cast<const char*>(&buffer), sizeof(buffer));
+                    written += sizeof(buffer);
+                    buffered -= 64;
+                    buffer = buffered ? rounded >> (width - buffered) : 0;
+                }
+            }
+        }
+    }
+    if(buffered){ // pad to a whole word so that digests can follow each other in one stream
+        stream.write(reinterpret_cast<const char*>(&buffer), sizeof(buffer));
+        written += sizeof(buffer);
+    }
+    return written;
+}
+
+/**
+ * 读取紧凑格式的摘要 - Load a digest in the compact format
+ * 输入不是本版本的紧凑摘要或不属于该上下文时，置位流的failbit并保持digest不变
+ * If the input is not a compact digest of this version or does not belong to the context, sets failbit on the stream and leaves digest unchanged
+ * @param digest 输出摘要，非NTT形式 - Output digest, not in NTT form
+ * @param context SEAL上下文 - SEAL context
+ * @param stream 输入流 - Input stream
+ */
+void loadCompactDigest(Ciphertext& digest, const SEALContext& context, istream& stream){
+    char magic[4] = {0, 0, 0, 0};
+    uint32_t version = 0;
+    stream.read(magic, sizeof(magic));
+    stream.read(reinterpret_cast<char*>(&version), sizeof(version));
+    if(!stream || !equal(magic, magic + 4, compactDigestMagic) || version != compactDigestVersion){
+        cerr << "The input is not a compact digest of version " << compactDigestVersion << "." << endl;
+        stream.setstate(ios::failbit);
+        return;
+    }
+    parms_id_type parms_id;
+    stream.read(reinterpret_cast<char*>(parms_id.data()), sizeof(parms_id_type));
+    uint32_t size = 0;
+    stream.read(reinterpret_cast<char*>(&size), sizeof(size));
+    if(!stream || size < 2 || size > SEAL_CIPHERTEXT_SIZE_MAX){
+        cerr << "The compact digest header is truncated or invalid." << endl;
+        stream.setstate(ios::failbit);
+        return;
+    }
+    vector<int> dropped(size);
+    for(size_t p = 0; p < size; p++){
+        uint8_t b = 0;
+        stream.read(reinterpret_cast<char*>(&b), 1);
+        dropped[p] = b;
+    }
+
+    auto context_data = context.get_context_data(parms_id);
+    if(!context_data){
+        cerr << "The compact digest does not belong to this context." << endl;
+        stream.setstate(ios::failbit);
+        return;
+    }
+    auto& coeff_modulus = context_data->parms().coeff_modulus();
+    for(size_t p = 0; p < size; p++){
+        for(auto& q : coeff_modulus){
+            if(dropped[p] >= q.bit_count()){
+                cerr << "The compact digest drops more bits than its coefficients have." << endl;
+                stream.setstate(ios::failbit);
+                return;
+            }
+        }
+    }
+    size_t degree = context_data->parms().poly_modulus_degree();
+    digest.resize(context, parms_id, size);
+    digest.is_ntt_form() = false;
+
+    uint64_t buffer = 0;
+    int buffered = 0;
+    for(size_t p = 0; p < size; p++){
+        uint64_t* poly = digest.data(p);
+        for(size_t r = 0; r < coeff_modulus.size(); r++){
+            int k = dropped[p];
+            int width = coeff_modulus[r].bit_count() - k;
+            uint64_t mask = (uint64_t(1) << width) - 1;
+            for(size_t c = r*degree; c < (r+1)*degree; c++){
+                uint64_t value;
+                if(buffered >= width){
+                    value = buffer;
+                    buffer >>= width;
+                    buffered -= width;
+                } else {
+                    // the rest of this coefficient is at the bottom of the next word
+                    uint64_t next = 0;
+                    stream.read(reinterpret_cast<char*>(&next), sizeof(next));
+                    value = buffer | (next << buffered);
+                    int used = width - buffered;
+                    buffer = next >> used;
+                    buffered = 64 - used;
+                }
+                poly[c] = (value & mask) << k;
+            }
+        }
+    }
+}
@@ -0,0 +1,263 @@
+#pragma once
+
+// 包含必要的头文件 - Include necessary header files
+#include "DetectionKeyGen.h"
+#include "DigestAccumulator.h"
+#include "LoadAndSaveUtils.h"
+#include "PVWToBFVSeal.h"
+#include "SwitchingKeyCache.h"
+#include "seal/seal.h"
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace seal;
+
+/**
+ * 持续摄取的检测守护进程 - Continuous ingestion detection daemon
+ * 监视只追加的线索和载荷日志（loadLogLength）。每当凑满degree条消息的批次，或部分批次等待超过flushInterval，
+ * 就为每个注册的接收者运行阶段1和阶段2，并将结果折叠进其DigestAccumulator
+ * Watches the append-only clue and payload log (loadLogLength). Whenever a batch of degree messages is full, or a partial batch has
+ * waited longer than flushInterval, runs phase 1 and phase 2 for every registered recipient and folds the result into its DigestAccumulator
+ * 检测的开销因此随时间分摊，而不是在接收者连接时集中出现 - The detection cost is thus spread over time instead of arriving when the recipient connects
+ * 注意 - Notes:
+ *      部分批次之后的批次不从degree的倍数开始，DigestAccumulator会把结果加到已有状态上
+ *      batches after a partial one do not start at multiples of degree, DigestAccumulator adds them to the existing state
+ *      能放入分量打包布局的部分批次（canPackPVWComponents）只做一次范围检查而不是ell次
+ *      partial batches that fit into the packed-components layout (canPackPVWComponents) run one range check instead of ell
+ *      追加失败的接收者停在失败的批次之前，在之后的步骤中重试
+ *      a recipient whose append fails stays before the failed batch and is retried in later steps
+ *      接收者的检测密钥在第一个批次时才展开，OMR2接收者的公钥从不展开
+ *      a recipient's detection key is only expanded at its first batch, and the public key of an OMR2 recipient is never expanded
+ */
+class DetectionDaemon{
+public:
+    /**
+     * @param context SEAL上下文 - SEAL context
+     * @param context_next 展开级别的子上下文 - Sub-context at the expansion level
+     * @param context_last 内积级别的子上下文 - Sub-context at the innerSum level
+     * @param context_packed 范围检查输出级别的子上下文 - Sub-context at the range check output level
+     * @param params PVW参数 - PVW parameters
+     * @param degree 多项式度数，即完整批次的大小 - Polynomial degree, i.e. the size of a full batch
+     * @param flushInterval 部分批次最长等待时间 - Longest wait of a partial batch
+     * @param pollInterval 日志轮询间隔 - Log polling interval
+     * @param firstMessage 开始监视的消息 - First message to watch
+     */
+    DetectionDaemon(const SEALContext& context, const SEALContext& context_next, const SEALContext& context_last,
+                    const SEALContext& context_packed, const PVWParam& params, const size_t degree,
+                    const chrono::milliseconds flushInterval = chrono::minutes(10),
+                    const chrono::milliseconds pollInterval = chrono::seconds(1), const size_t firstMessage = 0)
+    : context(context), context_next(context_next), context_last(context_last), context_packed(context_packed), params(params), degree(degree),
+      flushInterval(flushInterval), pollInterval(pollInterval), scanned(firstMessage)
+    {}
+
+    /**
+     * 注册接收者，密钥按值传入，可以移动 - Register a recipient, the keys are taken by value and can be moved in
+     * 落后于守护进程的累加器（例如从保存的状态恢复）会在下一步中追上 - An accumulator behind the daemon (e.g. resumed from a saved state) catches up in the next step
+     * @param switchingKey 切换密钥 - Switching keys
+     * @param relin_keys 重线性化密钥 - Relinearization keys
+     * @param gal_keys 包含步长1的伽罗瓦密钥 - Galois keys with step 1
+     * @param gal_keys_next 展开级别的伽罗瓦密钥 - Galois keys at the expansion level
+     * @param gal_keys_last 内积级别的伽罗瓦密钥 - Galois keys at the innerSum level
+     * @param public_key 公钥，仅OMR3使用 - Public key, only used by OMR3
+     * @param switchingKeyPacked 分量打包布局的切换密钥 - Switching key of the packed-components layout
+     * @param gal_keys_packed 范围检查输出级别的折叠密钥 - Folding keys at the range check output level
+     * @param accumulator 接收者的累加器 - The recipient's accumulator
+     * @return 接收者编号，失败时为-1 - Recipient id, -1 on failure
+     */
+    int registerRecipient(vector<Ciphertext> switchingKey, RelinKeys relin_keys, GaloisKeys gal_keys, GaloisKeys gal_keys_next,
+                        GaloisKeys gal_keys_last, PublicKey public_key, Ciphertext switchingKeyPacked, GaloisKeys gal_keys_packed,
+                        DigestAccumulator accumulator = DigestAccumulator()){
+        unique_ptr<LazyDetectionKey> keys(new LazyDetectionKey(context, context_next, context_last, context_packed, params));
+        keys->set(move(switchingKey), move(relin_keys), move(gal_keys), move(gal_keys_next), move(gal_keys_last), move(public_key),
+                move(switchingKeyPacked), move(gal_keys_packed));
+        return registerRecipient(move(keys), accumulator);
+    }
+
+    /**
+     * 以上传的种子化检测密钥注册接收者 - Register a recipient with its uploaded seeded detection key
+     * @param keys 由LazyDetectionKey::load读取的密钥 - Keys read by LazyDetectionKey::load
+     * @param accumulator 接收者的累加器 - The recipient's accumulator
+     * @return 接收者编号，失败时为-1 - Recipient id, -1 on failure
+     */
+    int registerRecipient(unique_ptr<LazyDetectionKey> keys, DigestAccumulator accumulator = DigestAccumulator()){
+        lock_guard<mutex> lock(recipientsMutex);
+        if(accumulator.numOfMessages() > scanned){
+            cerr << "The accumulator is ahead of the daemon, which has scanned " << scanned << " messages." << endl;
+            return -1;
+        }
+        unique_ptr<Recipient> recipient(new Recipient());
+        recipient->id = recipients.size();
+        recipient->keys = move(keys);
+        recipient->accumulator = accumulator;
+        recipients.push_back(move(recipient));
+        return int(recipients.size()) - 1;
+    }
+
+    /**
+     * 轮询日志一次，最多处理一个批次 - Poll the log once and process at most one batch
+     * @return 是否处理了批次 - Whether a batch was processed
+     */
+    bool step(){
+        size_t available = size_t(loadLogLength());
+        auto now = chrono::steady_clock::now();
+        lock_guard<mutex> lock(recipientsMutex);
+        for(size_t r = 0; r < recipients.size(); r++){
+            catchUp(*recipients[r]);
+        }
+        if(available <= scanned){
+            waiting = false;
+            flushRequested = false;
+            return false;
+        }
+        if(!waiting){
+            waiting = true;
+            waitingSince = now;
+        }
+        size_t batch = min(degree, available - scanned);
+        if(batch < degree && now - waitingSince < flushInterval && !flushRequested)
+            return false;
+
+        vector<PVWCiphertext> SICPVW;
+        vector<vector<uint64_t>> payload;
+        loadClues(SICPVW, int(scanned), int(scanned + batch), params);
+        loadData(payload, int(scanned), int(scanned + batch));
+        for(size_t r = 0; r < recipients.size(); r++){
+            // 落后的接收者由catchUp在之后的步骤中追上 - A lagging recipient is brought up by catchUp in a later step
+            if(recipients[r]->accumulator.numOfMessages() == scanned)
+                appendBatch(*recipients[r], SICPVW, payload, batch);
+        }
+        scanned += batch;
+        if(scanned >= available)
+            waiting = false;
+        return true;
+    }
+
+    /**
+     * 运行直到stop被置位 - Run until stop is set
+     * @param stop 停止标志 - Stop flag
+     */
+    void run(const atomic<bool>& stop){
+        while(!stop){
+            bool processed = false;
+            try{
+                processed = step();
+            } catch(const exception& e){
+                cerr << "Detection step failed: " << e.what() << endl;
+            }
+            if(!processed)
+                this_thread::sleep_for(pollInterval);
+        }
+    }
+
+    // 不等待计时器，处理所有已提交的消息，例如接收者连接时 - Process all committed messages without waiting for the timer, e.g. when a recipient connects
+    void flush(){
+        flushRequested = true;
+    }
+
+    /**
+     * 复制接收者的累加器 - Copy a recipient's accumulator
+     * 正在处理批次时会等待其完成 - Waits for the batch in progress, if any
+     * @param id 接收者编号 - Recipient id
+     * @param accumulator 输出累加器 - Output accumulator
+     * @return 是否成功 - Whether successful
+     */
+    bool snapshot(const int id, DigestAccumulator& accumulator){
+        lock_guard<mutex> lock(recipientsMutex);
+        if(id < 0 || size_t(id) >= recipients.size()){
+            cerr << "No recipient " << id << " is registered." << endl;
+            return false;
+        }
+        accumulator = recipients[id]->accumulator;
+        return true;
+    }
+
+    // 已读取的消息数，每个接收者的进度见其累加器 - Number of messages read, see each recipient's accumulator for its progress
+    size_t numOfMessages() const{
+        return scanned;
+    }
+
+private:
+    struct Recipient{
+        size_t id;
+        unique_ptr<LazyDetectionKey> keys;
+        unique_ptr<RotatedSwitchingKeyCache> switchingKeyCache; // refers to the switching key and gal_keys in keys, built at the first batch
+        DigestAccumulator accumulator;
+    };
+
+    // 阶段1和阶段2，与serverOperations1obtainPackedSIC（或其分量打包版本）和serverOperationsAppend相同 - Phase 1 and phase 2, same as serverOperations1obtainPackedSIC (or its packed-components version) and serverOperationsAppend
+    // 只有成功时才更新累加器 - The accumulator is only updated on success
+    bool appendBatch(Recipient& recipient, vector<PVWCiphertext>& SICPVW, const vector<vector<uint64_t>>& payload, const size_t batch){
+        try{
+            return appendBatchOrThrow(recipient, SICPVW, payload, batch);
+        } catch(const exception& e){
+            cerr << "Recipient " << recipient.id << " failed at message " << recipient.accumulator.numOfMessages() << ": " << e.what() << endl;
+            return false;
+        }
+    }
+
+    bool appendBatchOrThrow(Recipient& recipient, vector<PVWCiphertext>& SICPVW, const vector<vector<uint64_t>>& payload, const size_t batch){
+        LazyDetectionKey& keys = *recipient.keys;
+        vector<Ciphertext> packedSIC(params.ell);
+        int rangeToCheck = 850;
+        if(canPackPVWComponents(batch, degree, params)){
+            // 部分批次：所有分量放入一个密文 - Partial batch: all components in one ciphertext
+            computeBplusASPVWPackedComponents(packedSIC[0], SICPVW, keys.switchingKeyPacked(), keys.galoisKeys(), context, params);
+            newRangeCheckPVWPackedComponents(packedSIC[0], rangeToCheck, keys.relinKeys(), keys.galoisKeysPacked(), degree, context,
+                                            context_packed, params);
+        } else {
+            if(!recipient.switchingKeyCache){
+                string spill = switchingKeyCacheSpill_glb.empty() ? "" : switchingKeyCacheSpill_glb + "." + to_string(recipient.id);
+                int rotations = RotatedSwitchingKeyCache::rotationsWithinBudget(switchingKeyCacheBytes_glb, context, params);
+                recipient.switchingKeyCache.reset(new RotatedSwitchingKeyCache(keys.switchingKey(), keys.galoisKeys(), context, params,
+                                                                                rotations, spill));
+            }
+            computeBplusASPVWOptimized(packedSIC, SICPVW, *recipient.switchingKeyCache, context, params);
+            newRangeCheckPVW(packedSIC, rangeToCheck, keys.relinKeys(), degree, context, params);
+        }
+
+        static const PublicKey unused;
+        const PublicKey& public_key = recipient.accumulator.isRandomized() ? keys.publicKey() : unused;
+        // 在副本上追加，异常不会留下追加了一半的累加器 - Append to a copy so that an exception leaves no half-appended accumulator
+        DigestAccumulator updated = recipient.accumulator;
+        if(!updated.append(packedSIC[0], payload, batch, keys.galoisKeysNext(), keys.galoisKeysLast(), public_key,
+                            degree, context_next, context_last))
+            return false;
+        recipient.accumulator = move(updated);
+        return true;
+    }
+
+    // 将落后的累加器追到scanned - Bring a lagging accumulator up to scanned
+    void catchUp(Recipient& recipient){
+        vector<PVWCiphertext> SICPVW;
+        vector<vector<uint64_t>> payload;
+        while(recipient.accumulator.numOfMessages() < scanned){
+            size_t start = recipient.accumulator.numOfMessages();
+            size_t batch = min(degree, scanned - start);
+            loadClues(SICPVW, int(start), int(start + batch), params);
+            loadData(payload, int(start), int(start + batch));
+            if(!appendBatch(recipient, SICPVW, payload, batch))
+                return;
+        }
+    }
+
+    SEALContext context;
+    SEALContext context_next;
+    SEALContext context_last;
+    SEALContext context_packed;
+    PVWParam params;
+    size_t degree;
+    chrono::milliseconds flushInterval;
+    chrono::milliseconds pollInterval;
+
+    mutex recipientsMutex;                              // 保护recipients和处理过程 - Guards recipients and the processing
+    vector<unique_ptr<Recipient>> recipients;
+    atomic<size_t> scanned;                             // 日志已读到这里，追加失败的接收者落后于此 - The log has been read up to here, recipients whose append failed lag behind
+    atomic<bool> flushRequested{false};
+    bool waiting = false;                               // 是否有等待中的部分批次 - Whether a partial batch is waiting
+    chrono::steady_clock::time_point waitingSince;
+};
@@ -0,0 +1,384 @@
+#pragma once
+
+// 包含必要的头文件 - Include necessary header files
+#include "PVWToBFVSeal.h"
+#include "ParamProfiles.h"
+#include "seal/seal.h"
+#include <NTL/BasicThreadPool.h>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <vector>
+using namespace seal;
+
+/**
+ * 并行的检测密钥生成 - Parallel detection key generation
+ * 检测密钥的各部分（公钥、重线性化密钥、四组伽罗瓦密钥、ell个切换密钥密文、分量打包的切换密钥）互不依赖，在NTL线程池上并发生成，
+ * 每部分完成后立即以种子模式序列化并写入输出流，因此不需要在内存中保留整个密钥
+ * The parts of the detection key (public key, relinearization keys, four sets of Galois keys, ell switching key ciphertexts, the
+ * packed-components switching key) are independent, so they are generated concurrently on the NTL thread pool, and every part is
+ * serialized in seed mode and written to the output stream as soon as it is done, so the whole key is never held in memory
+ * 格式 - Format: 每部分 - per part: 编号 - id (uint32) | 长度 - length (uint64) | SEAL序列化 - SEAL serialization，部分按完成顺序出现 - parts appear in completion order
+ * 检测者用LazyDetectionKey读取，只在需要时展开各部分 - The detector reads it with LazyDetectionKey, which expands every part only when it is needed
+ * 每个部分使用自己的KeyGenerator或Encryptor - Every part uses its own KeyGenerator or Encryptor
+ */
+
+// 部分种类，最大的部分在前，以便最先开始 - Part kinds, the largest parts first so that they start first
+enum DetectionKeyPart : uint32_t{
+    KEY_GALOIS_LAST = 0,                // 内积级别的全部步长 - All steps at the innerSum level
+    KEY_GALOIS_NEXT,                    // 展开级别的步长0和1 - Steps 0 and 1 at the expansion level
+    KEY_RELIN,
+    KEY_GALOIS,                         // 完整级别的步长1 - Step 1 at the full level
+    KEY_PUBLIC,
+    KEY_SWITCHING,
+    KEY_GALOIS_PACKED,                  // 范围检查输出级别的折叠步长 - Folding steps at the range check output level
+    KEY_SWITCHING_PACKED                // 分量打包布局的切换密钥 - Switching key of the packed-components layout
+};
+
+// 部分编号：高16位为种类，低16位为伽罗瓦步长或切换密钥密文的下标 - Part id: the kind in the high 16 bits, the Galois step or the switching key index in the low 16 bits
+inline uint32_t detectionKeyPartId(const DetectionKeyPart kind, const int index = 0){
+    return (uint32_t(kind) << 16) | uint32_t(index);
+}
+
+// 完整检测密钥的所有部分编号，每个伽罗瓦元素单独成为一部分 - Ids of all parts of a complete detection key, every Galois element is a part of its own
+// 分量打包布局的部分只在该布局可用时存在 - The parts of the packed-components layout only exist when that layout is usable
+vector<uint32_t> detectionKeyParts(const size_t degree, const PVWParam& params){
+    vector<uint32_t> parts;
+    parts.push_back(detectionKeyPartId(KEY_GALOIS_LAST, 0));
+    for(int i = 1; i < int(degree/2); i *= 2){
+        parts.push_back(detectionKeyPartId(KEY_GALOIS_LAST, i));
+    }
+    parts.push_back(detectionKeyPartId(KEY_GALOIS_NEXT, 0));
+    parts.push_back(detectionKeyPartId(KEY_GALOIS_NEXT, 1));
+    parts.push_back(detectionKeyPartId(KEY_RELIN));
+    parts.push_back(detectionKeyPartId(KEY_GALOIS, 1));
+    parts.push_back(detectionKeyPartId(KEY_PUBLIC));
+    for(int j = 0; j < params.ell; j++){
+        parts.push_back(detectionKeyPartId(KEY_SWITCHING, j));
+    }
+    if(canPackPVWComponents(1, degree, params)){
+        for(int step : packedComponentsRotationSteps(degree, params)){
+            parts.push_back(detectionKeyPartId(KEY_GALOIS_PACKED, step));
+        }
+        parts.push_back(detectionKeyPartId(KEY_SWITCHING_PACKED));
+    }
+    return parts;
+}
+
+// 将只含部分伽罗瓦元素的密钥并入另一组密钥 - Merge keys holding some Galois elements into another set of keys
+void mergeGaloisKeys(GaloisKeys& keys, GaloisKeys& part){
+    auto& data = keys.data();
+    if(data.size() < part.data().size())
+        data.resize(part.data().size());
+    for(size_t i = 0; i < part.data().size(); i++){
+        if(!part.data()[i].empty())
+            data[i] = move(part.data()[i]);
+    }
+    keys.parms_id() = part.parms_id();
+}
+
+/**
+ * 并行生成检测密钥并流式写出 - Generate the detection key in parallel and stream it out
+ * 这是接收者上传的形式：所有部分都以种子模式保存，约为展开后大小的一半
+ * This is the form the recipient uploads: all parts are saved in seed mode, about half of their expanded size
+ * @param stream 输出流 - Output stream
+ * @param context 主上下文 - Main context
+ * @param context_next 展开级别的子上下文 - Sub-context at the expansion level
+ * @param context_last 内积级别的子上下文 - Sub-context at the innerSum level
+ * @param context_packed 范围检查输出级别的子上下文 - Sub-context at the range check output level
+ * @param secret_key 主私钥 - Main secret key
+ * @param regSk PVW私钥 - PVW secret key
+ * @param params PVW参数 - PVW parameters
+ * @return 写入的字节数 - Number of bytes written
+ */
+streamoff generateDetectionKey(ostream& stream, const SEALContext& context, const SEALContext& context_next, const SEALContext& context_last,
+                            const SEALContext& context_packed, const SecretKey& secret_key, const PVWsk& regSk, const PVWParam& params){
+    size_t degree = context.key_context_data()->parms().poly_modulus_degree();
+    vector<uint32_t> parts = detectionKeyParts(degree, params);
+
+    mutex streamMutex;
+    streamoff written = 0;
+    NTL_EXEC_RANGE(long(parts.size()), first, last);
+    for(long p = first; p < last; p++){
+        stringstream buffer;
+        DetectionKeyPart kind = DetectionKeyPart(parts[p] >> 16);
+        int index = int(parts[p] & 0xFFFF);
+        if(kind == KEY_GALOIS_LAST){
+            KeyGenerator keygen_last(context_last, levelSpecificSecretKey(secret_key, context, context_last));
+            keygen_last.create_galois_keys(vector<int>({index})).save(buffer);
+        } else if(kind == KEY_GALOIS_NEXT){
+            KeyGenerator keygen_next(context_next, levelSpecificSecretKey(secret_key, context, context_next));
+            keygen_next.create_galois_keys(vector<int>({index})).save(buffer);
+        } else if(kind == KEY_RELIN){
+            KeyGenerator keygen(context, secret_key);
+            keygen.create_relin_keys().save(buffer);
+        } else if(kind == KEY_GALOIS){
+            KeyGenerator keygen(context, secret_key);
+            keygen.create_galois_keys(vector<int>({index})).save(buffer);
+        } else if(kind == KEY_PUBLIC){
+            KeyGenerator keygen(context, secret_key);
+            keygen.create_public_key().save(buffer);
+        } else if(kind == KEY_GALOIS_PACKED){
+            KeyGenerator keygen_packed(context_packed, levelSpecificSecretKey(secret_key, context, context_packed));
+            keygen_packed.create_galois_keys(vector<int>({index})).save(buffer);
+        } else if(kind == KEY_SWITCHING_PACKED){
+            BatchEncoder batch_encoder(context);
+            Encryptor encryptor(context, secret_key);
+            vector<uint64_t> skInt;
+            packPVWSecretKeyComponents(skInt, regSk, degree, params);
+            Plaintext plaintext;
+            batch_encoder.encode(skInt, plaintext);
+            encryptor.encrypt_symmetric(plaintext).save(buffer);
+        } else {
+            BatchEncoder batch_encoder(context);
+            Encryptor encryptor(context, secret_key);
+            vector<uint64_t> skInt;
+            packPVWSecretKey(skInt, regSk, index, degree, params);
+            Plaintext plaintext;
+            batch_encoder.encode(skInt, plaintext);
+            encryptor.encrypt_symmetric(plaintext).save(buffer);
+        }
+
+        string bytes = buffer.str();
+        uint32_t id = parts[p];
+        uint64_t size = bytes.size();
+        lock_guard<mutex> lock(streamMutex);
+        stream.write(reinterpret_cast<const char*>(&id), sizeof(id));
+        stream.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        stream.write(bytes.data(), bytes.size());
+        written += sizeof(id) + sizeof(size) + bytes.size();
+    }
+    NTL_EXEC_RANGE_END;
+    return written;
+}
+
+/**
+ * 检测者端按需展开的检测密钥 - Detection key expanded on demand on the detector side
+ * 上传的各部分以种子形式保存，每部分在第一次被访问时才展开（按级别，伽罗瓦密钥按元素），之后缓存展开结果并释放种子形式
+ * The uploaded parts are kept in seeded form, and every part is only expanded the first time it is accessed (per level, and per
+ * element for Galois keys); the expansion is cached afterwards and the seeded form is released
+ * 因此从不使用某些密钥的接收者（例如OMR2不用公钥）不为它们付出展开后的内存
+ * Recipients that never use some keys (e.g. OMR2 does not use the public key) thus never pay the expanded memory for them
+ * 注意 - Note: 访问函数之间是线程安全的，但向一组伽罗瓦密钥并入新元素时，不能有其他线程正在用它求值
+ * the accessors are thread-safe among themselves, but no other thread may be evaluating with a set of Galois keys while new elements are merged into it
+ */
+class LazyDetectionKey{
+public:
+    /**
+     * @param context 主上下文 - Main context
+     * @param context_next 展开级别的子上下文 - Sub-context at the expansion level
+     * @param context_last 内积级别的子上下文 - Sub-context at the innerSum level
+     * @param context_packed 范围检查输出级别的子上下文 - Sub-context at the range check output level
+     * @param params PVW参数 - PVW parameters
+     */
+    LazyDetectionKey(const SEALContext& context, const SEALContext& context_next, const SEALContext& context_last,
+                    const SEALContext& context_packed, const PVWParam& params)
+    : context(context), context_next(context_next), context_last(context_last), context_packed(context_packed), params(params)
+    {}
+
+    /**
+     * 读取上传的检测密钥，不展开任何部分 - Read an uploaded detection key without expanding any part
+     * 长度在分配前按该部分序列化后的上限检查，未知或重复的部分被拒绝
+     * Lengths are checked against the largest serialization of the part before allocating, and unknown or repeated parts are rejected
+     * @param stream 由generateDetectionKey写出的输入流 - Input stream written by generateDetectionKey
+     * @return 是否所有部分都已读取 - Whether all parts were read
+     */
+    bool load(istream& stream){
+        lock_guard<mutex> lock(expandMutex);
+        size_t degree = context.key_context_data()->parms().poly_modulus_degree();
+        vector<uint32_t> parts = detectionKeyParts(degree, params);
+        uint64_t kindSize[KEY_SWITCHING_PACKED + 1];
+        for(uint32_t kind = 0; kind <= KEY_SWITCHING_PACKED; kind++){
+            kindSize[kind] = maxPartSize(DetectionKeyPart(kind));
+        }
+        map<uint32_t, uint64_t> maxSize;
+        for(uint32_t part : parts){
+            maxSize[part] = kindSize[part >> 16];
+        }
+
+        uint32_t id;
+        uint64_t size;
+        while(stream.read(reinterpret_cast<char*>(&id), sizeof(id)) && stream.read(reinterpret_cast<char*>(&size), sizeof(size))){
+            auto bound = maxSize.find(id);
+            if(bound == maxSize.end() || seeded.count(id)){
+                cerr << "The detection key has an unknown or repeated part " << id << "." << endl;
+                return false;
+            }
+            if(size > bound->second){
+                cerr << "Part " << (id >> 16) << ":" << (id & 0xFFFF) << " of the detection key claims " << size << " bytes, more than "
+                     << bound->second << "." << endl;
+                return false;
+            }
+            string bytes(size, '\0');
+            stream.read(&bytes[0], size);
+            if(!stream){
+                cerr << "The detection key is truncated." << endl;
+                return false;
+            }
+            uploaded += sizeof(id) + sizeof(size) + size;
+            seeded[id] = move(bytes);
+        }
+        for(uint32_t part : parts){
+            if(!seeded.count(part)){
+                cerr << "Part " << (part >> 16) << ":" << (part & 0xFFFF) << " of the detection key is missing." << endl;
+                return false;
+            }
+        }
+        expandedSwitchingKey.assign(params.ell, Ciphertext());
+        return true;
+    }
+
+    /**
+     * 使用已展开的密钥，例如由接收者在本地生成时 - Use keys that are already expanded, e.g. when generated locally by the recipient
+     */
+    void set(vector<Ciphertext> switchingKey, RelinKeys relin_keys, GaloisKeys gal_keys, GaloisKeys gal_keys_next, GaloisKeys gal_keys_last,
+            PublicKey public_key, Ciphertext switchingKeyPacked, GaloisKeys gal_keys_packed){
+        lock_guard<mutex> lock(expandMutex);
+        seeded.clear();
+        expandedSwitchingKey = move(switchingKey);
+        expandedRelinKeys = move(relin_keys);
+        expandedGalKeys = move(gal_keys);
+        expandedGalKeysNext = move(gal_keys_next);
+        expandedGalKeysLast = move(gal_keys_last);
+        expandedPublicKey = move(public_key);
+        expandedSwitchingKeyPacked = move(switchingKeyPacked);
+        expandedGalKeysPacked = move(gal_keys_packed);
+    }
+
+    const vector<Ciphertext>& switchingKey(){
+        lock_guard<mutex> lock(expandMutex);
+        for(int j = 0; j < params.ell; j++){
+            expand(detectionKeyPartId(KEY_SWITCHING, j), [&](istream& in){ expandedSwitchingKey[j].load(context, in); });
+        }
+        return expandedSwitchingKey;
+    }
+
+    const RelinKeys& relinKeys(){
+        lock_guard<mutex> lock(expandMutex);
+        expand(detectionKeyPartId(KEY_RELIN), [&](istream& in){ expandedRelinKeys.load(context, in); });
+        return expandedRelinKeys;
+    }
+
+    const PublicKey& publicKey(){
+        lock_guard<mutex> lock(expandMutex);
+        expand(detectionKeyPartId(KEY_PUBLIC), [&](istream& in){ expandedPublicKey.load(context, in); });
+        return expandedPublicKey;
+    }
+
+    // 分量打包布局的切换密钥，仅当canPackPVWComponents成立时可用 - Switching key of the packed-components layout, only usable when canPackPVWComponents holds
+    const Ciphertext& switchingKeyPacked(){
+        lock_guard<mutex> lock(expandMutex);
+        expand(detectionKeyPartId(KEY_SWITCHING_PACKED), [&](istream& in){ expandedSwitchingKeyPacked.load(context, in); });
+        return expandedSwitchingKeyPacked;
+    }
+
+    // 完整级别的伽罗瓦密钥（步长1）- Galois keys at the full level (step 1)
+    const GaloisKeys& galoisKeys(){
+        lock_guard<mutex> lock(expandMutex);
+        expandGalois(expandedGalKeys, KEY_GALOIS, context, {});
+        return expandedGalKeys;
+    }
+
+    /**
+     * 展开级别的伽罗瓦密钥 - Galois keys at the expansion level
+     * @param steps 需要的步长，空则展开所有上传的步长 - Steps needed, all uploaded steps if empty
+     */
+    GaloisKeys& galoisKeysNext(const vector<int>& steps = {}){
+        lock_guard<mutex> lock(expandMutex);
+        expandGalois(expandedGalKeysNext, KEY_GALOIS_NEXT, context_next, steps);
+        return expandedGalKeysNext;
+    }
+
+    /**
+     * 内积级别的伽罗瓦密钥 - Galois keys at the innerSum level
+     * @param steps 需要的步长，空则展开所有上传的步长 - Steps needed, all uploaded steps if empty
+     */
+    GaloisKeys& galoisKeysLast(const vector<int>& steps = {}){
+        lock_guard<mutex> lock(expandMutex);
+        expandGalois(expandedGalKeysLast, KEY_GALOIS_LAST, context_last, steps);
+        return expandedGalKeysLast;
+    }
+
+    // 范围检查输出级别的折叠密钥 - Folding keys at the range check output level
+    const GaloisKeys& galoisKeysPacked(){
+        lock_guard<mutex> lock(expandMutex);
+        expandGalois(expandedGalKeysPacked, KEY_GALOIS_PACKED, context_packed, {});
+        return expandedGalKeysPacked;
+    }
+
+    // 上传的字节数 - Number of bytes uploaded
+    size_t uploadedBytes() const{
+        return uploaded;
+    }
+
+    // 尚未展开的部分数 - Number of parts not expanded yet
+    size_t pendingParts(){
+        lock_guard<mutex> lock(expandMutex);
+        return seeded.size();
+    }
+
+private:
+    // 一种部分序列化后的上限：若干个密钥级别、大小为2的密文，加上KSwitchKeys的头部
+    // Bound on the serialization of a part kind: some size-2 ciphertexts at the key level, plus the KSwitchKeys headers
+    uint64_t maxPartSize(const DetectionKeyPart kind) const{
+        const SEALContext& level = kind == KEY_GALOIS_LAST ? context_last : kind == KEY_GALOIS_NEXT ? context_next
+                                 : kind == KEY_GALOIS_PACKED ? context_packed : context;
+        auto key_context_data = level.key_context_data();
+        Ciphertext ct;
+        ct.resize(level, key_context_data->parms_id(), 2);
+        size_t ciphertexts = (kind == KEY_PUBLIC || kind == KEY_SWITCHING || kind == KEY_SWITCHING_PACKED) ? 1 : key_context_data->parms().coeff_modulus().size();
+        return ciphertexts * uint64_t(ct.save_size()) + 4096;
+    }
+
+    // 若该部分仍为种子形式则展开并释放 - Expand the part and release it if it is still seeded
+    template<typename Load>
+    void expand(const uint32_t id, Load load){
+        auto it = seeded.find(id);
+        if(it == seeded.end())
+            return;
+        stringstream buffer(it->second);
+        load(buffer);
+        seeded.erase(it);
+    }
+
+    void expandGalois(GaloisKeys& keys, const DetectionKeyPart kind, const SEALContext& level, const vector<int>& steps){
+        auto begin = seeded.lower_bound(detectionKeyPartId(kind, 0));
+        auto end = seeded.lower_bound(detectionKeyPartId(DetectionKeyPart(kind + 1), 0));
+        vector<uint32_t> ids;
+        if(steps.empty()){
+            for(auto it = begin; it != end; it++)
+                ids.push_back(it->first);
+        } else {
+            for(int step : steps)
+                if(step >= 0 && step <= 0xFFFF)
+                    ids.push_back(detectionKeyPartId(kind, step));
+        }
+        for(uint32_t id : ids){
+            expand(id, [&](istream& in){
+                GaloisKeys part;
+                part.load(level, in);
+                mergeGaloisKeys(keys, part);
+            });
+        }
+    }
+
+    SEALContext context;
+    SEALContext context_next;
+    SEALContext context_last;
+    SEALContext context_packed;
+    PVWParam params;
+
+    mutex expandMutex;                                  // 保护种子形式和展开过程 - Guards the seeded form and the expansion
+    map<uint32_t, string> seeded;                       // 尚未展开的部分 - Parts not expanded yet
+    size_t uploaded = 0;
+    vector<Ciphertext> expandedSwitchingKey;
+    RelinKeys expandedRelinKeys;
+    GaloisKeys expandedGalKeys;
+    GaloisKeys expandedGalKeysNext;
+    GaloisKeys expandedGalKeysLast;
+    GaloisKeys expandedGalKeysPacked;
+    PublicKey expandedPublicKey;
+    Ciphertext expandedSwitchingKeyPacked;
+};
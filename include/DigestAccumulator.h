@@ -0,0 +1,308 @@
+#pragma once
+
+// 包含必要的头文件 - Include necessary header files
+#include "PVWToBFVSeal.h"
+#include "retrieval.h"
+#include "seal/seal.h"
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+using namespace seal;
+
+/**
+ * 增量摘要累加器 - Incremental digest accumulator
+ * 保存阶段2的NTT形式状态（OMR2的索引块/rhs，或OMR3的lhs/lhsCounter/rhs）以及已扫描的消息数
+ * Keeps the NTT-form phase 2 state (index blocks/rhs of OMR2, or lhs/lhsCounter/rhs of OMR3) together with the number of messages scanned
+ * 新发布的消息只需在新范围上运行阶段1和阶段2即可追加，无需重新扫描整个公告板
+ * Newly posted messages are appended by running phase 1 and phase 2 on the new range only, without rescanning the board
+ * 二分图映射不保存：每行由(seed, 索引)导出，每次追加只生成新消息的行
+ * No bipartite map is kept: every row is derived from (seed, index), and each append only derives the rows of the new messages
+ * 范围查询模式 - Range query mode:
+ *      firstMessage = indexBase = start 时只处理[start, end)内的批次，索引相对于start编码，接收者解码时传入indexBase
+ *      with firstMessage = indexBase = start only the batches in [start, end) are processed and indices are encoded relative to start;
+ *      the recipient passes indexBase to the decoder. OMR2 then needs one index block per 16*degree messages of the range,
+ *      and OMR3 drops the high index part for ranges of up to 65537 messages
+ */
+class DigestAccumulator{
+public:
+    /**
+     * @param randomized OMR3的随机化索引(true)或OMR2的确定性索引(false) - Randomized indices of OMR3 (true) or deterministic indices of OMR2 (false)
+     * @param firstMessage 第一条消息的索引，用于只覆盖一个时段的部分摘要 - Index of the first message, for partial digests covering one epoch only
+     * @param indexBase 索引相对于它编码，不大于firstMessage - Indices are encoded relative to it, at most firstMessage
+     */
+    DigestAccumulator(const bool randomized = false, const size_t firstMessage = 0, const size_t indexBase = 0)
+    : randomized(randomized), counter(firstMessage), indexBase(min(indexBase, firstMessage))
+    {}
+
+    /**
+     * 追加新消息 - Append new messages
+     * 新消息的索引从numOfMessages()开始 - The new messages are indexed from numOfMessages() on
+     * @param packedSIC 阶段1对新消息的输出，会被旋转 - Phase 1 output for the new messages, rotated in place
+     * @param payload 新消息的载荷 - Payloads of the new messages
+     * @param numOfNew 新消息数量，不超过degree - Number of new messages, at most degree
+     * @param gal_keys 伽罗瓦密钥 - Galois keys
+     * @param gal_keys_last 内积级别的伽罗瓦密钥 - Galois keys at the innerSum level
+     * @param public_key 公钥，仅OMR3使用 - Public key, only used by OMR3
+     * @param degree 多项式度数 - Polynomial degree
+     * @param context SEAL上下文 - SEAL context
+     * @param context2 第二个SEAL上下文 - Second SEAL context
+     * @return 是否成功 - Whether successful
+     */
+    bool append(Ciphertext& packedSIC, const vector<vector<uint64_t>>& payload, const size_t numOfNew, const GaloisKeys& gal_keys,
+                const GaloisKeys& gal_keys_last, const PublicKey& public_key, const size_t& degree, const SEALContext& context, const SEALContext& context2){
+        if(numOfNew > degree || payload.size() < numOfNew){
+            cerr << "Append at most " << degree << " messages, each with a payload, at one time." << endl;
+            return false;
+        }
+        vector<vector<int>> bipartite_map, weights;
+        bipartiteGraphWeightsWindow(bipartite_map, weights, counter, counter + numOfNew,
+                                    randomized ? OMRthreeM : OMRtwoM, repeatition_glb, seed_glb);
+
+        Evaluator evaluator(context);
+        size_t step = 32;                            // 与serverOperations2therest相同 - Same as serverOperations2therest
+        for(size_t local = 0; local < numOfNew;){
+            size_t batch = min(step, numOfNew - local);
+            if(!randomized) // a batch must not straddle an index block
+                batch = min(batch, 16*degree - (counter + local - indexBase) % (16*degree));
+            vector<Ciphertext> expandedSIC;
+            expandSIC(expandedSIC, packedSIC, gal_keys, gal_keys_last, degree, context, context2, batch, local);
+            for(size_t j = 0; j < expandedSIC.size(); j++)
+                if(!expandedSIC[j].is_ntt_form())
+                    evaluator.transform_to_ntt_inplace(expandedSIC[j]);
+
+            if(randomized)
+                appendRandomized(expandedSIC, payload, bipartite_map, weights, gal_keys, public_key, degree, context, context2, counter + local, local);
+            else
+                appendDeterministic(expandedSIC, payload, bipartite_map, weights, degree, context, counter + local, local);
+            local += batch;
+        }
+        counter += numOfNew;
+        return true;
+    }
+
+    /**
+     * OMR2摘要，非NTT形式 - OMR2 digest, not in NTT form
+     * @param lhsOut 索引块，没有消息的块为空 - Index blocks, empty for blocks without messages
+     * @param rhsOut 载荷摘要 - Payload digest
+     * @param context SEAL上下文 - SEAL context
+     */
+    void digest(vector<Ciphertext>& lhsOut, Ciphertext& rhsOut, const SEALContext& context) const{
+        Evaluator evaluator(context);
+        lhsOut = lhs;
+        rhsOut = rhs;
+        for(size_t k = 0; k < lhsOut.size(); k++)
+            if(lhsOut[k].is_ntt_form())
+                evaluator.transform_from_ntt_inplace(lhsOut[k]);
+        if(rhsOut.is_ntt_form())
+            evaluator.transform_from_ntt_inplace(rhsOut);
+    }
+
+    /**
+     * OMR3摘要，非NTT形式 - OMR3 digest, not in NTT form
+     * 相对索引都小于65537时高位部分全为零，不输出 - When all relative indices are below 65537 the high parts are all zero and left out
+     * @param lhsOut 随机化索引摘要 - Randomized index digest
+     * @param lhsCounterOut 索引计数器 - Index counters
+     * @param rhsOut 载荷摘要 - Payload digest
+     * @param context SEAL上下文 - SEAL context
+     */
+    void digest(vector<vector<Ciphertext>>& lhsOut, vector<Ciphertext>& lhsCounterOut, Ciphertext& rhsOut, const SEALContext& context) const{
+        Evaluator evaluator(context);
+        lhsOut = lhsRandomized;
+        lhsCounterOut = lhsCounter;
+        rhsOut = rhs;
+        for(size_t i = 0; i < lhsOut.size(); i++){
+            if(counter - indexBase <= 65537)
+                lhsOut[i].erase(lhsOut[i].begin());
+            for(size_t j = 0; j < lhsOut[i].size(); j++)
+                evaluator.transform_from_ntt_inplace(lhsOut[i][j]);
+            evaluator.transform_from_ntt_inplace(lhsCounterOut[i]);
+        }
+        if(rhsOut.is_ntt_form())
+            evaluator.transform_from_ntt_inplace(rhsOut);
+    }
+
+    /**
+     * 保存状态 - Save the state
+     * 格式 - Format: randomized | 是否已初始化 - initialized | 下一条消息 - next message | 索引基准 - index base | 密文 - ciphertexts
+     * @param stream 输出流 - Output stream
+     * @return 写入的字节数 - Number of bytes written
+     */
+    streamoff save(ostream& stream) const{
+        uint8_t flags[2] = {uint8_t(randomized), uint8_t(initialized)};
+        uint64_t messages[2] = {counter, indexBase};
+        stream.write(reinterpret_cast<const char*>(flags), sizeof(flags));
+        stream.write(reinterpret_cast<const char*>(messages), sizeof(messages));
+        streamoff written = sizeof(flags) + sizeof(messages);
+        if(!initialized)
+            return written;
+
+        if(randomized){
+            uint32_t C = uint32_t(lhsCounter.size());
+            stream.write(reinterpret_cast<const char*>(&C), sizeof(C));
+            written += sizeof(C);
+            for(size_t i = 0; i < C; i++){
+                written += lhsRandomized[i][0].save(stream);
+                written += lhsRandomized[i][1].save(stream);
+                written += lhsCounter[i].save(stream);
+            }
+        } else {
+            uint32_t blocks = uint32_t(lhs.size());
+            stream.write(reinterpret_cast<const char*>(&blocks), sizeof(blocks));
+            written += sizeof(blocks);
+            for(size_t k = 0; k < blocks; k++){
+                uint8_t present = lhs[k].size() > 0;
+                stream.write(reinterpret_cast<const char*>(&present), 1);
+                written += 1;
+                if(present)
+                    written += lhs[k].save(stream);
+            }
+        }
+        written += rhs.save(stream);
+        return written;
+    }
+
+    /**
+     * 读取状态 - Load the state
+     * @param stream 输入流 - Input stream
+     * @param context 包含状态级别的SEAL上下文 - SEAL context containing the level of the state
+     */
+    void load(istream& stream, const SEALContext& context){
+        uint8_t flags[2] = {0, 0};
+        uint64_t messages[2] = {0, 0};
+        stream.read(reinterpret_cast<char*>(flags), sizeof(flags));
+        stream.read(reinterpret_cast<char*>(messages), sizeof(messages));
+        randomized = flags[0];
+        initialized = flags[1];
+        counter = size_t(messages[0]);
+        indexBase = size_t(messages[1]);
+        if(!initialized)
+            return;
+
+        if(randomized){
+            uint32_t C = 0;
+            stream.read(reinterpret_cast<char*>(&C), sizeof(C));
+            lhsRandomized.resize(C, vector<Ciphertext>(2));
+            lhsCounter.resize(C);
+            for(size_t i = 0; i < C; i++){
+                lhsRandomized[i][0].load(context, stream);
+                lhsRandomized[i][1].load(context, stream);
+                lhsCounter[i].load(context, stream);
+            }
+        } else {
+            uint32_t blocks = 0;
+            stream.read(reinterpret_cast<char*>(&blocks), sizeof(blocks));
+            lhs.assign(blocks, Ciphertext());
+            for(size_t k = 0; k < blocks; k++){
+                uint8_t present = 0;
+                stream.read(reinterpret_cast<char*>(&present), 1);
+                if(present)
+                    lhs[k].load(context, stream);
+            }
+        }
+        rhs.load(context, stream);
+    }
+
+    // 下一条消息的索引，从0开始时即已扫描的消息数 - Index of the next message, the number of messages scanned when starting from 0
+    size_t numOfMessages() const{
+        return counter;
+    }
+
+    // 是否为OMR3的随机化索引 - Whether the indices are the randomized ones of OMR3
+    bool isRandomized() const{
+        return randomized;
+    }
+
+private:
+    // 零密文，用于从degree的非整数倍处开始的状态 - Zero ciphertext, for states starting off a multiple of degree
+    static void zeroNTT(Ciphertext& ct, const SEALContext& context, const parms_id_type& parms_id){
+        ct.resize(context, parms_id, 2);
+        ct.is_ntt_form() = true;
+        fill_n(ct.data(), ct.size() * ct.poly_modulus_degree() * ct.coeff_modulus_size(), 0ULL);
+    }
+
+    // 检索内核在degree的整数倍处重新初始化其输出，已有状态时先写入临时密文再累加
+    // The retrieval kernels reinitialize their outputs at multiples of degree, so with an existing state they write to temporaries that are then added
+    // 索引内核按相对索引计，载荷打包按绝对索引计 - The index kernels count relative indices, payload packing counts absolute ones
+    // 二分图窗口的第一行描述 start - local - The first row of the bipartite window describes start - local
+    void appendDeterministic(const vector<Ciphertext>& expandedSIC, const vector<vector<uint64_t>>& payload, const vector<vector<int>>& bipartite_map,
+                            const vector<vector<int>>& weights, const size_t& degree, const SEALContext& context, const size_t start, const size_t local){
+        size_t block = (start - indexBase) / (16*degree);
+        size_t blockBase = indexBase + block*16*degree;
+        if(lhs.size() <= block)
+            lhs.resize(block + 1);
+        bool fresh = ((start - indexBase) % degree) == 0;
+        bool blockInitialized = lhs[block].size() > 0;
+        if(!fresh){
+            if(!blockInitialized)
+                zeroNTT(lhs[block], context, expandedSIC[0].parms_id());
+            if(!initialized)
+                zeroNTT(rhs, context, expandedSIC[0].parms_id());
+        }
+        bool separateIndex = blockInitialized && fresh;
+        bool separatePayload = initialized && fresh;
+        Ciphertext templhs, temprhs;
+        fusedIndexPayloadRetrieval(separateIndex ? templhs : lhs[block], separatePayload ? temprhs : rhs, expandedSIC, payload,
+                                    bipartite_map, weights, context, degree, start, local, 306, blockBase, start - local);
+        Evaluator evaluator(context);
+        if(separateIndex)
+            evaluator.add_inplace(lhs[block], templhs);
+        if(separatePayload)
+            evaluator.add_inplace(rhs, temprhs);
+        initialized = true;
+    }
+
+    void appendRandomized(vector<Ciphertext>& expandedSIC, const vector<vector<uint64_t>>& payload, const vector<vector<int>>& bipartite_map,
+                        const vector<vector<int>>& weights, const GaloisKeys& gal_keys,
+                        const PublicKey& public_key, const size_t& degree, const SEALContext& context, const SEALContext& context2,
+                        const size_t start, const size_t local){
+        bool indexFresh = ((start - indexBase) % degree) == 0;
+        bool payloadFresh = (start % degree) == 0;
+        if(!initialized && !indexFresh){
+            lhsRandomized.resize(C_glb, vector<Ciphertext>(2));
+            lhsCounter.resize(C_glb);
+            for(size_t i = 0; i < C_glb; i++){
+                zeroNTT(lhsRandomized[i][0], context, expandedSIC[0].parms_id());
+                zeroNTT(lhsRandomized[i][1], context, expandedSIC[0].parms_id());
+                zeroNTT(lhsCounter[i], context, expandedSIC[0].parms_id());
+            }
+        }
+        if(!initialized && !payloadFresh){
+            zeroNTT(rhs, context, expandedSIC[0].parms_id());
+        }
+        bool separateIndex = initialized && indexFresh;
+        bool separatePayload = initialized && payloadFresh;
+        vector<vector<Ciphertext>> templhs;
+        vector<Ciphertext> templhsCounter;
+        Ciphertext temprhs;
+        // relative counters below 65537 leave the high part untouched
+        randomizedIndexRetrieval(separateIndex ? templhs : lhsRandomized, separateIndex ? templhsCounter : lhsCounter, expandedSIC,
+                                context2, public_key, int(start - indexBase), degree, C_glb);
+
+        vector<vector<Ciphertext>> payloadUnpacked;
+        payloadRetrievalSparseWithWeights(payloadUnpacked, payload, bipartite_map, weights, expandedSIC, context, degree, start, local, 306, start - local);
+        payloadPackingOptimized(separatePayload ? temprhs : rhs, payloadUnpacked, bipartite_map, degree, context, gal_keys, start);
+
+        Evaluator evaluator(context);
+        if(separateIndex){
+            for(size_t i = 0; i < lhsCounter.size(); i++){
+                evaluator.add_inplace(lhsRandomized[i][0], templhs[i][0]);
+                evaluator.add_inplace(lhsRandomized[i][1], templhs[i][1]);
+                evaluator.add_inplace(lhsCounter[i], templhsCounter[i]);
+            }
+        }
+        if(separatePayload){
+            evaluator.add_inplace(rhs, temprhs);
+        }
+        initialized = true;
+    }
+
+    bool randomized;
+    bool initialized = false;
+    size_t counter;                            // 下一条消息的索引 - Index of the next message
+    size_t indexBase;                          // 索引相对于它编码 - Indices are encoded relative to it
+    vector<Ciphertext> lhs;                    // OMR2索引块 - OMR2 index blocks
+    Ciphertext rhs;
+    vector<vector<Ciphertext>> lhsRandomized;  // OMR3
+    vector<Ciphertext> lhsCounter;             // OMR3
+};
@@ -0,0 +1,175 @@
+#pragma once
+
+// 包含必要的头文件 - Include necessary header files
+#include "seal/seal.h"
+#include <iostream>
+#include <map>
+#include <vector>
+using namespace seal;
+
+/**
+ * 分层的按时段部分摘要存储 - Hierarchical store of per-epoch partial digests
+ * 摘要是可加的：不相交消息范围的部分摘要相加即为并集的摘要（与OMR2中多核结果的add_inplace归约相同）
+ * Digests are additive: the partial digests of disjoint message ranges add up to the digest of their union
+ * (the same add_inplace reduction that OMR2 uses for the per-core results)
+ * 第0层每个节点覆盖epochSize条消息，第l+1层的节点由第l层fanouts[l]个相邻节点合并而成（如小时、天、周）
+ * Level 0 nodes cover epochSize messages each, and a level l+1 node merges fanouts[l] adjacent level l nodes (e.g. hours, days, weeks)
+ * 任意与时段对齐的[start, end)查询由每层至多2*(fanout-1)个节点相加得到，与公告板历史长度的关系为对数
+ * Any epoch-aligned [start, end) query sums at most 2*(fanout-1) nodes per level, logarithmic in the board history
+ * 部分摘要是一组密文，按位置相加 - A partial digest is a list of ciphertexts, added position-wise:
+ *      OMR2为{rhs, 索引块...}，OMR3为rhs、lhs和lhsCounter展开后的列表 - {rhs, index blocks...} for OMR2, the flattened rhs, lhs and lhsCounter for OMR3
+ *      较短的列表和空密文（size() == 0）代表零，因此不同时段可以有不同数量的索引块
+ *      shorter lists and empty ciphertexts (size() == 0) stand for zero, so epochs may have different numbers of index blocks
+ * 每个接收者一个存储 - One store per recipient
+ */
+class EpochDigestStore{
+public:
+    /**
+     * @param epochSize 每个时段的消息数 - Number of messages per epoch
+     * @param fanouts 每层合并的节点数 - Number of nodes merged at each level
+     */
+    EpochDigestStore(const size_t epochSize, const vector<size_t>& fanouts = {24, 7})
+    : fanouts(fanouts)
+    {
+        spans.push_back(epochSize);
+        for(size_t l = 0; l < fanouts.size(); l++){
+            spans.push_back(spans.back() * fanouts[l]);
+        }
+        levels.resize(spans.size());
+    }
+
+    /**
+     * 添加一个完整时段的部分摘要，并合并已完整的上层节点 - Add the partial digest of a complete epoch, and merge the upper nodes that are complete
+     * 尚未结束的时段由调用者的DigestAccumulator保存 - The epoch in progress stays in the caller's DigestAccumulator
+     * @param partial 部分摘要 - Partial digest
+     * @param start 时段的第一条消息，是epochSize的倍数 - First message of the epoch, a multiple of epochSize
+     * @param context SEAL上下文 - SEAL context
+     * @return 是否成功 - Whether successful
+     */
+    bool addEpoch(const vector<Ciphertext>& partial, const size_t start, const SEALContext& context){
+        if(start % spans[0] != 0){
+            cerr << "Epochs start at multiples of " << spans[0] << " messages." << endl;
+            return false;
+        }
+        levels[0][start] = partial;
+
+        // merge upwards as long as all siblings are present
+        Evaluator evaluator(context);
+        size_t nodeStart = start;
+        for(size_t l = 0; l + 1 < levels.size(); l++){
+            size_t parentStart = nodeStart - nodeStart % spans[l+1];
+            if(levels[l+1].count(parentStart))
+                break;
+            bool complete = true;
+            for(size_t k = 0; k < fanouts[l] && complete; k++){
+                complete = levels[l].count(parentStart + k*spans[l]) > 0;
+            }
+            if(!complete)
+                break;
+
+            vector<Ciphertext> merged = levels[l].at(parentStart);
+            for(size_t k = 1; k < fanouts[l]; k++){
+                addPartial(merged, levels[l].at(parentStart + k*spans[l]), evaluator);
+            }
+            levels[l+1][parentStart] = merged;
+            nodeStart = parentStart;
+        }
+        return true;
+    }
+
+    /**
+     * 查询[start, end)内消息的摘要 - Query the digest of the messages in [start, end)
+     * 贪心地使用从当前位置开始、不超过end的最高层节点 - Greedily uses the highest node that starts at the current position and does not pass end
+     * @param result 摘要 - Digest
+     * @param start 起始消息，是epochSize的倍数 - First message, a multiple of epochSize
+     * @param end 结束消息，是epochSize的倍数 - End message, a multiple of epochSize
+     * @param context SEAL上下文 - SEAL context
+     * @return 范围是否被存储的节点覆盖 - Whether the range is covered by the stored nodes
+     */
+    bool query(vector<Ciphertext>& result, const size_t start, const size_t end, const SEALContext& context) const{
+        result.clear();
+        if(start % spans[0] != 0 || end % spans[0] != 0 || start >= end){
+            cerr << "Queries are epoch-aligned, non-empty ranges of multiples of " << spans[0] << " messages." << endl;
+            return false;
+        }
+
+        Evaluator evaluator(context);
+        size_t position = start;
+        while(position < end){
+            bool found = false;
+            for(size_t l = levels.size(); l-- > 0 && !found;){
+                if(position % spans[l] != 0 || position + spans[l] > end)
+                    continue;
+                auto it = levels[l].find(position);
+                if(it == levels[l].end())
+                    continue;
+                if(result.empty())
+                    result = it->second;
+                else
+                    addPartial(result, it->second, evaluator);
+                position += spans[l];
+                found = true;
+            }
+            if(!found){
+                cerr << "Messages from " << position << " on are not covered, they may have been compacted." << endl;
+                result.clear();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * 压缩：删除结束于before之前、已被上层节点覆盖的节点 - Compaction: drop the nodes that end before `before` and are covered by an upper node
+     * 较早的历史只能以较粗的粒度查询 - Older history can then only be queried at a coarser granularity
+     * @param before 消息索引 - Message index
+     * @return 删除的节点数 - Number of nodes dropped
+     */
+    size_t compact(const size_t before){
+        size_t dropped = 0;
+        for(size_t l = 0; l + 1 < levels.size(); l++){
+            for(auto it = levels[l].begin(); it != levels[l].end();){
+                size_t parentStart = it->first - it->first % spans[l+1];
+                if(parentStart + spans[l+1] <= before && levels[l+1].count(parentStart)){
+                    it = levels[l].erase(it);
+                    dropped++;
+                } else {
+                    it++;
+                }
+            }
+        }
+        return dropped;
+    }
+
+    // 存储的部分摘要数 - Number of partial digests stored
+    size_t numOfPartials() const{
+        size_t count = 0;
+        for(size_t l = 0; l < levels.size(); l++){
+            count += levels[l].size();
+        }
+        return count;
+    }
+
+    // 时段大小 - Epoch size
+    size_t epochSize() const{
+        return spans[0];
+    }
+
+private:
+    static void addPartial(vector<Ciphertext>& sum, const vector<Ciphertext>& partial, const Evaluator& evaluator){
+        if(sum.size() < partial.size())
+            sum.resize(partial.size());
+        for(size_t i = 0; i < partial.size(); i++){
+            if(partial[i].size() == 0)
+                continue;
+            if(sum[i].size() == 0)
+                sum[i] = partial[i];
+            else
+                evaluator.add_inplace(sum[i], partial[i]);
+        }
+    }
+
+    vector<size_t> fanouts;
+    vector<size_t> spans;                           // 每层节点覆盖的消息数 - Messages covered by a node at each level
+    vector<map<size_t, vector<Ciphertext>>> levels; // 每层按起始消息索引 - Indexed by first message at each level
+};
@@ -0,0 +1,679 @@
+#pragma once
+
+#include "seal/seal.h"
+#include <NTL/BasicThreadPool.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+using namespace std;
+using namespace seal;
+
+// Self-contained PVW over contiguous uint32_t arrays, without PALISADE.
+// Entries are below q <= 2^17, so a product fits in 34 bits and an inner product of up to 2^29 terms is summed in uint64_t
+// and reduced once, which lets the compiler vectorize the loops.
+// regevEncryption.h converts from and to PVWCiphertext/PVWsk/PVWpk for the code that still uses NativeVector.
+
+struct PVWParam{
+    int n;
+    int q;
+    double std_dev;
+    int m;
+    int ell;
+    PVWParam(){
+        n = 450;
+        q = 65537;
+        std_dev = 1.3;
+        m = 16000;
+        ell = 4;
+    }
+    PVWParam(int n, int q, double std_dev, int m, int ell)
+    : n(n), q(q), std_dev(std_dev), m(m), ell(ell)
+    {}
+};
+
+// ell secret vectors of n entries, row-major
+struct FlatPVWsk{
+    int n = 0;
+    int ell = 0;
+    vector<uint32_t> s;
+};
+
+struct FlatPVWCiphertext{
+    vector<uint32_t> a;
+    vector<uint32_t> b;
+};
+
+// 256-bit PRG seed
+typedef array<uint64_t, 4> FlatLWESeed;
+
+// m rows of n + ell entries, a then b
+struct FlatPVWpk{
+    size_t m = 0;
+    size_t width = 0;
+    vector<uint32_t> rows;
+    bool seeded = false;        // the a parts are expanded from seed, see FlatPVWGeneratePublicKeySeeded
+    FlatLWESeed seed = {};
+};
+
+// Cryptographic PRG: SEAL's Blake2xb XOF on a 256-bit seed and a 64-bit stream index, so every (seed, index) gives an
+// independent stream. Words are drawn from SEAL in blocks, which amortizes the lock in UniformRandomGenerator::generate.
+class FlatLWEPRG{
+public:
+    typedef uint64_t result_type;
+
+    FlatLWEPRG(const FlatLWESeed& seed, const uint64_t index = 0){
+        prng_seed_type key = {};
+        copy(seed.begin(), seed.end(), key.begin());
+        key[seed.size()] = index;
+        prng = Blake2xbPRNGFactory(key).create();
+    }
+
+    // a copy would repeat the buffered words
+    FlatLWEPRG(const FlatLWEPRG&) = delete;
+    FlatLWEPRG& operator=(const FlatLWEPRG&) = delete;
+    FlatLWEPRG(FlatLWEPRG&&) = default;
+    FlatLWEPRG& operator=(FlatLWEPRG&&) = default;
+
+    static FlatLWESeed freshSeed(){
+        FlatLWESeed seed;
+        for(auto& w : seed)
+            w = random_uint64();
+        return seed;
+    }
+
+    static constexpr result_type min(){
+        return 0;
+    }
+
+    static constexpr result_type max(){
+        return UINT64_MAX;
+    }
+
+    result_type operator()(){
+        if(next == blockWords){
+            prng->generate(sizeof(block), reinterpret_cast<seal_byte*>(block.data()));
+            next = 0;
+        }
+        return block[next++];
+    }
+
+private:
+    static constexpr size_t blockWords = 256;
+
+    shared_ptr<UniformRandomGenerator> prng;
+    array<uint64_t, blockWords> block;
+    size_t next = blockWords;
+};
+
+// len entries below q, two 32-bit draws per PRG call, rejected above the largest multiple of q
+inline void flatLWEUniform(FlatLWEPRG& prng, uint32_t* out, const size_t len, const uint32_t q){
+    uint64_t limit = (uint64_t(1) << 32) / q * q;
+    size_t i = 0;
+    while(i < len){
+        uint64_t r = prng();
+        uint64_t lo = r & 0xFFFFFFFF, hi = r >> 32;
+        if(lo < limit)
+            out[i++] = uint32_t(lo % q);
+        if(hi < limit && i < len)
+            out[i++] = uint32_t(hi % q);
+    }
+}
+
+// Uniform and discrete Gaussian noise from FlatLWEPRG.
+// The Gaussian is sampled by inversion of a cumulative distribution table (CDT) of |e| over [0, 12 std_dev], at 63 bits of
+// precision, with the sign from the remaining bit of the same draw. Every sample scans the whole table without branching on
+// the secret, and the table only depends on std_dev, so the noise is the same on every standard library.
+class FlatLWESampler{
+public:
+    FlatLWESampler(const double std_dev, const FlatLWESeed& seed, const uint64_t index = 0)
+    : prng(seed, index)
+    {
+        buildTable(std_dev);
+    }
+
+    FlatLWESampler(const double std_dev)
+    : FlatLWESampler(std_dev, FlatLWEPRG::freshSeed())
+    {}
+
+    void setDeviation(const double std_dev){
+        if(deviation != std_dev)
+            buildTable(std_dev);
+    }
+
+    void uniform(uint32_t* out, const size_t len, const uint32_t q){
+        flatLWEUniform(prng, out, len, q);
+    }
+
+    uint32_t gaussian(const uint32_t q){
+        uint64_t r = prng();
+        uint64_t u = r >> 1, magnitude = 0;
+        for(size_t k = 0; k < cdt.size(); k++){
+            magnitude += uint64_t(u >= cdt[k]);
+        }
+        uint64_t negative = 0 - (r & 1);
+        return uint32_t((((q - magnitude) & negative) | (magnitude & ~negative)) % q);
+    }
+
+    uint64_t next(){
+        return prng();
+    }
+
+private:
+    // cdt[k] = 2^63 P(|e| <= k) for the Gaussian rho(x) = exp(-x^2 / (2 std_dev^2)) restricted to |x| <= tail
+    void buildTable(const double std_dev){
+        deviation = std_dev;
+        size_t tail = size_t(ceil(12 * std_dev));
+        vector<long double> rho(tail + 1);
+        long double total = 0;
+        for(size_t k = 0; k <= tail; k++){
+            rho[k] = expl(-(long double)(k * k) / (2.0L * std_dev * std_dev));
+            total += k ? 2 * rho[k] : rho[k];
+        }
+        cdt.assign(tail, 0);
+        long double cumulative = 0;
+        for(size_t k = 0; k < tail; k++){
+            cumulative += k ? 2 * rho[k] : rho[k];
+            cdt[k] = uint64_t(min(ldexpl(cumulative / total, 63), ldexpl(1, 63)));
+        }
+    }
+
+    FlatLWEPRG prng;
+    double deviation = 0;
+    vector<uint64_t> cdt;
+};
+
+// Per-thread sampler for the functions below
+inline FlatLWESampler& flatLWESampler(const double std_dev){
+    thread_local FlatLWESampler sampler(std_dev);
+    sampler.setDeviation(std_dev);
+    return sampler;
+}
+
+inline uint32_t flatInnerProduct(const uint32_t* a, const uint32_t* s, const size_t n, const uint32_t q){
+    uint64_t sum = 0;
+    for(size_t i = 0; i < n; i++){
+        sum += uint64_t(a[i]) * s[i];
+    }
+    return uint32_t(sum % q);
+}
+
+/////////////////////////////////////////////////////////////////// Below are implementation
+
+FlatPVWsk FlatPVWGenerateSecretKey(const PVWParam& param){
+    FlatPVWsk sk;
+    sk.n = param.n;
+    sk.ell = param.ell;
+    sk.s.resize(size_t(param.n) * param.ell);
+    flatLWESampler(param.std_dev).uniform(sk.s.data(), sk.s.size(), uint32_t(param.q));
+    return sk;
+}
+
+// writes b (ell entries) for a given a (n entries)
+void FlatPVWEncSKGivenA(const uint32_t* a, uint32_t* b, const vector<int>& msg, const FlatPVWsk& sk, const PVWParam& param,
+                    FlatLWESampler& sampler, const bool pk_gen = false){
+    uint32_t q = uint32_t(param.q);
+    for(int j = 0; j < param.ell; j++){
+        uint64_t v = flatInnerProduct(a, &sk.s[size_t(j) * param.n], param.n, q);
+        if(!pk_gen)
+            v += msg[j] ? 3*uint64_t(q)/4 : uint64_t(q)/4;
+        v += sampler.gaussian(q);
+        b[j] = uint32_t(v % q);
+    }
+}
+
+// writes a (n entries) and b (ell entries)
+void FlatPVWEncSKInto(uint32_t* a, uint32_t* b, const vector<int>& msg, const FlatPVWsk& sk, const PVWParam& param,
+                    FlatLWESampler& sampler, const bool pk_gen = false){
+    sampler.uniform(a, param.n, uint32_t(param.q));
+    FlatPVWEncSKGivenA(a, b, msg, sk, param, sampler, pk_gen);
+}
+
+// the a part (n entries) of row i of a seeded public key, anyone holding the seed can expand it
+inline void flatPVWSeededRowA(uint32_t* a, const FlatLWESeed& seed, const size_t i, const size_t n, const uint32_t q){
+    FlatLWEPRG prng(seed, i);
+    flatLWEUniform(prng, a, n, q);
+}
+
+void FlatPVWEncSK(FlatPVWCiphertext& ct, const vector<int>& msg, const FlatPVWsk& sk, const PVWParam& param, const bool pk_gen = false){
+    ct.a.resize(param.n);
+    ct.b.resize(param.ell);
+    FlatPVWEncSKInto(ct.a.data(), ct.b.data(), msg, sk, param, flatLWESampler(param.std_dev), pk_gen);
+}
+
+// rows are generated in parallel on the NTL thread pool, every range with its own sampler
+FlatPVWpk FlatPVWGeneratePublicKey(const PVWParam& param, const FlatPVWsk& sk){
+    FlatPVWpk pk;
+    pk.m = param.m;
+    pk.width = param.n + param.ell;
+    pk.rows.resize(pk.m * pk.width);
+    FlatLWESeed seed = FlatLWEPRG::freshSeed();
+    vector<int> zeros(param.ell, 0);
+    NTL_EXEC_RANGE(long(pk.m), first, last);
+    FlatLWESampler sampler(param.std_dev, seed, uint64_t(first));
+    for(long i = first; i < last; i++){
+        uint32_t* row = &pk.rows[size_t(i) * pk.width];
+        FlatPVWEncSKInto(row, row + param.n, zeros, sk, param, sampler, true);
+    }
+    NTL_EXEC_RANGE_END;
+    return pk;
+}
+
+// Same distribution, with the a parts expanded from a public seed so that a saved key only needs seed and the b parts.
+// The noise still comes from fresh secret randomness.
+FlatPVWpk FlatPVWGeneratePublicKeySeeded(const PVWParam& param, const FlatPVWsk& sk, const FlatLWESeed& seed = FlatLWEPRG::freshSeed()){
+    FlatPVWpk pk;
+    pk.m = param.m;
+    pk.width = param.n + param.ell;
+    pk.rows.resize(pk.m * pk.width);
+    pk.seeded = true;
+    pk.seed = seed;
+    FlatLWESeed noiseSeed = FlatLWEPRG::freshSeed();
+    vector<int> zeros(param.ell, 0);
+    NTL_EXEC_RANGE(long(pk.m), first, last);
+    FlatLWESampler sampler(param.std_dev, noiseSeed, uint64_t(first));
+    for(long i = first; i < last; i++){
+        uint32_t* row = &pk.rows[size_t(i) * pk.width];
+        flatPVWSeededRowA(row, seed, i, size_t(param.n), uint32_t(param.q));
+        FlatPVWEncSKGivenA(row, row + param.n, zeros, sk, param, sampler, true);
+    }
+    NTL_EXEC_RANGE_END;
+    return pk;
+}
+
+void FlatPVWDec(vector<int>& msg, const FlatPVWCiphertext& ct, const FlatPVWsk& sk, const PVWParam& param){
+    msg.resize(param.ell);
+    uint32_t q = uint32_t(param.q);
+    for(int j = 0; j < param.ell; j++){
+        uint32_t inner = flatInnerProduct(ct.a.data(), &sk.s[size_t(j) * param.n], param.n, q);
+        uint32_t r = (ct.b[j] + q - inner) % q;
+        msg[j] = (r < q/2)? 0 : 1;
+    }
+}
+
+/////////////////////////////////////////////////////////////////// Compact public-key files
+
+// Entries are bit-packed at the width of q-1 (17 bits for q = 65537, 16 for q <= 65536) in little-endian 64-bit words after the header.
+// A seeded key only stores the ell b entries of every row, the a parts are expanded from the seed.
+// The words start 8-byte aligned, so FlatPVWpkMap reads them in place from a read-only mapping.
+struct FlatPVWpkHeader{
+    char magic[4];              // "PVWK"
+    uint32_t version;
+    uint32_t n;
+    uint32_t ell;
+    uint32_t m;
+    uint32_t q;
+    uint32_t bits;
+    uint32_t seeded;
+    uint64_t seed[4];           // FlatLWESeed
+};
+
+inline uint32_t flatPVWEntryBits(const uint32_t q){
+    uint32_t bits = 1;
+    while(bits < 32 && (uint64_t(q) - 1) >> bits)
+        bits++;
+    return bits;
+}
+
+// entry e of a bit-packed array
+inline uint32_t flatUnpackEntry(const uint64_t* words, const uint64_t e, const uint32_t bits){
+    uint64_t bit = e * bits;
+    uint64_t w = bit / 64, shift = bit % 64;
+    uint64_t v = words[w] >> shift;
+    if(shift + bits > 64)
+        v |= words[w + 1] << (64 - shift);
+    return uint32_t(v & ((uint64_t(1) << bits) - 1));
+}
+
+// returns the number of bytes written
+streamoff saveFlatPVWpk(const FlatPVWpk& pk, const PVWParam& param, ostream& stream){
+    FlatPVWpkHeader header;
+    memcpy(header.magic, "PVWK", 4);
+    header.version = 2;
+    header.n = uint32_t(param.n);
+    header.ell = uint32_t(param.ell);
+    header.m = uint32_t(pk.m);
+    header.q = uint32_t(param.q);
+    header.bits = flatPVWEntryBits(uint32_t(param.q));
+    header.seeded = pk.seeded ? 1 : 0;
+    copy(pk.seed.begin(), pk.seed.end(), header.seed);
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    size_t skip = pk.seeded ? size_t(param.n) : 0;
+    size_t entries = pk.m * (pk.width - skip);
+    vector<uint64_t> words((entries * header.bits + 63) / 64, 0);
+    uint64_t e = 0;
+    for(size_t i = 0; i < pk.m; i++){
+        for(size_t j = skip; j < pk.width; j++, e++){
+            uint64_t bit = e * header.bits, v = pk.rows[i * pk.width + j];
+            words[bit / 64] |= v << (bit % 64);
+            if(bit % 64 + header.bits > 64)
+                words[bit / 64 + 1] |= v >> (64 - bit % 64);
+        }
+    }
+    stream.write(reinterpret_cast<const char*>(words.data()), words.size() * sizeof(uint64_t));
+    return streamoff(sizeof(header) + words.size() * sizeof(uint64_t));
+}
+
+// Read-only mapping of a compact public-key file. Rows are unpacked (and for seeded keys, their a parts expanded) on access,
+// so many recipients' keys can be opened without loading them; expand() materializes a key that is used for many clues.
+class FlatPVWpkMap{
+public:
+    FlatPVWpkMap() = default;
+
+    FlatPVWpkMap(const string& path){
+        open(path);
+    }
+
+    ~FlatPVWpkMap(){
+        close();
+    }
+
+    FlatPVWpkMap(const FlatPVWpkMap&) = delete;
+    FlatPVWpkMap& operator=(const FlatPVWpkMap&) = delete;
+
+    bool open(const string& path){
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0){
+            cerr << "Cannot open " << path << "." << endl;
+            return false;
+        }
+        struct stat st;
+        if(fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(FlatPVWpkHeader)){
+            cerr << path << " is not a PVW public key." << endl;
+            ::close(fd);
+            return false;
+        }
+        void* mapped = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if(mapped == MAP_FAILED){
+            cerr << "Cannot map " << path << "." << endl;
+            return false;
+        }
+        base = mapped;
+        length = size_t(st.st_size);
+        header = static_cast<const FlatPVWpkHeader*>(base);
+        words = reinterpret_cast<const uint64_t*>(static_cast<const char*>(base) + sizeof(FlatPVWpkHeader));
+
+        rowEntries = header->seeded ? header->ell : header->n + header->ell;
+        size_t needed = sizeof(FlatPVWpkHeader) + (uint64_t(header->m) * rowEntries * header->bits + 63) / 64 * sizeof(uint64_t);
+        if(memcmp(header->magic, "PVWK", 4) != 0 || header->version != 2 || header->bits != flatPVWEntryBits(header->q) || length < needed){
+            cerr << path << " is not a PVW public key of this version or is truncated." << endl;
+            close();
+            return false;
+        }
+        m = header->m;
+        width = header->n + header->ell;
+        copy(header->seed, header->seed + 4, seed.begin());
+        return true;
+    }
+
+    void close(){
+        if(base)
+            munmap(base, length);
+        base = nullptr;
+        header = nullptr;
+        length = 0;
+        m = width = 0;
+    }
+
+    bool isOpen() const{
+        return base != nullptr;
+    }
+
+    // whether the key was saved for these parameters
+    bool matches(const PVWParam& param) const{
+        return isOpen() && int(header->n) == param.n && int(header->ell) == param.ell && int(header->q) == param.q && int(header->m) == param.m;
+    }
+
+    // writes the width entries of row i, a then b, with the dimensions from the header
+    void row(const size_t i, uint32_t* out) const{
+        size_t skip = 0;
+        if(header->seeded){
+            flatPVWSeededRowA(out, seed, i, header->n, header->q);
+            skip = header->n;
+        }
+        uint64_t e = uint64_t(i) * rowEntries;
+        for(size_t j = skip; j < width; j++, e++){
+            out[j] = flatUnpackEntry(words, e, header->bits);
+        }
+    }
+
+    FlatPVWpk expand() const{
+        FlatPVWpk pk;
+        pk.m = m;
+        pk.width = width;
+        pk.rows.resize(m * width);
+        pk.seeded = header->seeded != 0;
+        pk.seed = seed;
+        NTL_EXEC_RANGE(long(m), first, last);
+        for(long i = first; i < last; i++){
+            row(size_t(i), &pk.rows[size_t(i) * width]);
+        }
+        NTL_EXEC_RANGE_END;
+        return pk;
+    }
+
+    size_t m = 0;
+    size_t width = 0;
+
+private:
+    void* base = nullptr;
+    size_t length = 0;
+    const FlatPVWpkHeader* header = nullptr;
+    const uint64_t* words = nullptr;
+    size_t rowEntries = 0;
+    FlatLWESeed seed = {};
+};
+
+// adds the 3q/4 or q/4 offset of msg to a subset sum
+inline void flatPVWAddMessage(FlatPVWCiphertext& ct, const vector<int>& msg, const PVWParam& param){
+    for(int j = 0; j < param.ell; j++){
+        uint64_t shift = msg[j] ? 3*uint64_t(param.q)/4 : uint64_t(param.q)/4;
+        ct.b[j] = uint32_t((ct.b[j] + shift) % uint64_t(param.q));
+    }
+}
+
+// Same distribution as PVWEncPK, for senders and board generators that encrypt many clues.
+// Entries are below q, so (2^32-1)/(q-1) - 1 rows (65535 for q = 65537, more than m) can be summed without reducing,
+// and the masked adds over a row vectorize.
+// The subset of every clue comes from 64 bits per FlatLWEPRG call, and a batch of clues reads every public-key row once.
+class FlatPVWBatchEncryptor{
+public:
+    FlatPVWBatchEncryptor(FlatPVWpk pk, const PVWParam& param)
+    : param(param), pk(move(pk)), prng(FlatLWEPRG::freshSeed())
+    {
+        reduceEvery = size_t(UINT32_MAX / uint32_t(param.q - 1)) - 1;
+    }
+
+    // reads the rows from a mapped key, which must stay open and match param; every pass unpacks each row once per tile
+    FlatPVWBatchEncryptor(const FlatPVWpkMap& map, const PVWParam& param)
+    : param(param), prng(FlatLWEPRG::freshSeed()), map(&map)
+    {
+        if(!map.matches(param))
+            throw invalid_argument("the mapped PVW public key is not open or was saved for other parameters");
+        reduceEvery = size_t(UINT32_MAX / uint32_t(param.q - 1)) - 1;
+        pk.m = map.m;
+        pk.width = map.width;
+        rowBuffer.resize(pk.width);
+    }
+
+    void encrypt(vector<FlatPVWCiphertext>& cts, const vector<vector<int>>& msgs){
+        subsetSums(cts, msgs.size());
+        for(size_t c = 0; c < msgs.size(); c++){
+            flatPVWAddMessage(cts[c], msgs[c], param);
+        }
+    }
+
+    // encryptions of zero without the q/4 offset, i.e. the message-independent part of encrypt
+    void subsetSums(vector<FlatPVWCiphertext>& cts, const size_t count){
+        size_t width = pk.width;
+        size_t words = (pk.m + 63) / 64;
+        cts.resize(count);
+        for(size_t start = 0; start < count; start += tile){
+            size_t batch = min(size_t(tile), count - start); // a copy, min would ODR-use tile before C++17
+            subset.resize(batch * words);
+            for(size_t w = 0; w < subset.size(); w++){
+                subset[w] = prng();
+            }
+            accumulator.assign(batch * width, 0);
+
+            for(size_t i = 0; i < pk.m; i++){
+                const uint32_t* row = rowBuffer.data();
+                if(map)
+                    map->row(i, rowBuffer.data());
+                else
+                    row = &pk.rows[i * width];
+                for(size_t c = 0; c < batch; c++){
+                    uint32_t mask = 0 - uint32_t((subset[c * words + i / 64] >> (i % 64)) & 1);
+                    uint32_t* acc = &accumulator[c * width];
+                    for(size_t j = 0; j < width; j++){
+                        acc[j] += row[j] & mask;
+                    }
+                }
+                if((i + 1) % reduceEvery == 0){
+                    for(size_t j = 0; j < accumulator.size(); j++){
+                        accumulator[j] %= uint32_t(param.q);
+                    }
+                }
+            }
+
+            for(size_t c = 0; c < batch; c++){
+                const uint32_t* acc = &accumulator[c * width];
+                FlatPVWCiphertext& ct = cts[start + c];
+                ct.a.resize(param.n);
+                ct.b.resize(param.ell);
+                for(int j = 0; j < param.n; j++){
+                    ct.a[j] = acc[j] % uint32_t(param.q);
+                }
+                for(int j = 0; j < param.ell; j++){
+                    ct.b[j] = acc[param.n + j] % uint32_t(param.q);
+                }
+            }
+        }
+    }
+
+private:
+    static constexpr size_t tile = 16;      // clues sharing one pass over the public key, their accumulators stay in cache
+
+    PVWParam param;
+    FlatPVWpk pk;
+    size_t reduceEvery;
+    FlatLWEPRG prng;
+    vector<uint64_t> subset;
+    vector<uint32_t> accumulator;
+    const FlatPVWpkMap* map = nullptr;
+    vector<uint32_t> rowBuffer;
+};
+
+// Offline/online clue generation for one recipient public key.
+// A background thread keeps up to capacity subset sums ready; pop takes one and only adds the ell message offsets,
+// so a clue costs microseconds at send time. Every subset sum is handed out once: reusing one would link two clues.
+class FlatPVWCluePool{
+public:
+    FlatPVWCluePool(FlatPVWpk pk, const PVWParam& param, const size_t capacity = 1024)
+    : param(param), capacity(max(capacity, size_t(1))), encryptor(move(pk), param)
+    {
+        refiller = thread([this](){ refill(); });
+    }
+
+    // the mapped key must stay open while the pool exists
+    FlatPVWCluePool(const FlatPVWpkMap& map, const PVWParam& param, const size_t capacity = 1024)
+    : param(param), capacity(max(capacity, size_t(1))), encryptor(map, param)
+    {
+        refiller = thread([this](){ refill(); });
+    }
+
+    ~FlatPVWCluePool(){
+        {
+            lock_guard<mutex> lock(poolMutex);
+            stopping = true;
+        }
+        needMore.notify_all();
+        refiller.join();
+    }
+
+    FlatPVWCluePool(const FlatPVWCluePool&) = delete;
+    FlatPVWCluePool& operator=(const FlatPVWCluePool&) = delete;
+
+    // waits for the background thread if the pool is empty
+    void pop(FlatPVWCiphertext& ct, const vector<int>& msg){
+        {
+            unique_lock<mutex> lock(poolMutex);
+            haveSome.wait(lock, [this](){ return !pool.empty(); });
+            ct = move(pool.front());
+            pool.pop_front();
+        }
+        needMore.notify_one();
+        flatPVWAddMessage(ct, msg, param);
+    }
+
+    // false instead of waiting if the pool is empty
+    bool tryPop(FlatPVWCiphertext& ct, const vector<int>& msg){
+        {
+            lock_guard<mutex> lock(poolMutex);
+            if(pool.empty())
+                return false;
+            ct = move(pool.front());
+            pool.pop_front();
+        }
+        needMore.notify_one();
+        flatPVWAddMessage(ct, msg, param);
+        return true;
+    }
+
+    size_t size(){
+        lock_guard<mutex> lock(poolMutex);
+        return pool.size();
+    }
+
+private:
+    static constexpr size_t chunk = 64;     // subset sums computed per refill, several tiles of the batch encryptor
+
+    void refill(){
+        vector<FlatPVWCiphertext> sums;
+        while(true){
+            size_t missing;
+            {
+                unique_lock<mutex> lock(poolMutex);
+                needMore.wait(lock, [this](){ return stopping || pool.size() < capacity; });
+                if(stopping)
+                    return;
+                missing = min(size_t(chunk), capacity - pool.size());
+            }
+            encryptor.subsetSums(sums, missing);
+            {
+                lock_guard<mutex> lock(poolMutex);
+                for(auto& ct : sums)
+                    pool.push_back(move(ct));
+            }
+            haveSome.notify_all();
+        }
+    }
+
+    PVWParam param;
+    size_t capacity;
+    FlatPVWBatchEncryptor encryptor;    // only used by the background thread
+
+    mutex poolMutex;
+    condition_variable haveSome;
+    condition_variable needMore;
+    deque<FlatPVWCiphertext> pool;
+    bool stopping = false;
+    thread refiller;
+};
@@ -0,0 +1,217 @@
+#pragma once
+
+// 包含必要的头文件 - Include necessary header files
+#include "regevEncryption.h"
+#include "seal/seal.h"
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace seal;
+
+/**
+ * BFV噪声模型 - BFV noise model
+ * 噪声以log2(不变噪声)表示，解密要求其小于-1，即SEAL的噪声预算为 -noise-1
+ * Noise is tracked as log2 of the invariant noise; decryption needs it below -1, i.e. SEAL's noise budget is -noise-1
+ * 这是平均情况的启发式估计，常数与OMR2/OMR3中手动放置的模数切换一致，尚未与测量的噪声预算比较
+ * These are average-case heuristics, with constants that agree with the hand-placed switches of OMR2/OMR3, and have not been
+ * compared with measured noise budgets
+ */
+struct NoiseModel{
+    double plainBits;   // log2(t)
+    double degreeBits;  // log2(N)
+
+    NoiseModel(const SEALContext& context){
+        auto& parms = context.key_context_data()->parms();
+        plainBits = log2(double(parms.plain_modulus().value()));
+        degreeBits = log2(double(parms.poly_modulus_degree()));
+    }
+
+    // 模数切换到log2(Q)位后的舍入噪声 - Rounding noise after switching to a modulus of log2(Q) bits
+    double floor(const double modulusBits) const{
+        return plainBits + degreeBits/2 + 1 - modulusBits;
+    }
+    // 新鲜密文的噪声 - Noise of a fresh ciphertext
+    double fresh(const double modulusBits) const{
+        return floor(modulusBits) + 3;
+    }
+    // 密文乘法和重线性化 - Ciphertext multiplication and relinearization
+    double multiplication() const{
+        return plainBits + degreeBits/2 + 3;
+    }
+    // 与批量编码的明文相乘 - Multiplication by a batch-encoded plaintext
+    double plainMultiplication() const{
+        return plainBits + degreeBits/2;
+    }
+    // terms个独立噪声的和 - Sum of terms independent noises
+    double sum(const double terms) const{
+        return log2(terms)/2;
+    }
+    // 一串旋转带来的密钥切换噪声 - Key switching noise of a chain of rotations
+    double rotations() const{
+        return 1;
+    }
+};
+
+/**
+ * 模数级别计划器 - Modulus level planner
+ * 按计算顺序描述电路的各个步骤及其噪声增长，为每一步选择最低的安全级别：
+ * Describe the steps of a circuit in evaluation order with their noise growth, and pick the lowest safe level for each step:
+ *      在每一步之前，尽可能降低模数，只要剩余电路在解密时仍有marginBits位的余量
+ *      before every step, switch down as far as the rest of the circuit still decrypts with marginBits to spare
+ * 级别以保留的数据素数个数表示 - Levels are given as the number of data primes kept
+ * 只用于报告：流水线仍使用手动放置的模数切换 - Report only: the pipeline still uses its hand-placed switches
+ */
+class LevelPlanner{
+public:
+    LevelPlanner(const SEALContext& context, const double marginBits = 2)
+    : noise(context), marginBits(marginBits)
+    {
+        auto context_data = context.first_context_data();
+        size_t maxPrimes = context_data->parms().coeff_modulus().size();
+        modulusBits.resize(maxPrimes + 1, 0);
+        while(context_data){
+            size_t k = context_data->parms().coeff_modulus().size();
+            modulusBits[k] = context_data->total_coeff_modulus_bit_count();
+            context_data = context_data->next_context_data();
+        }
+    }
+
+    /**
+     * 添加一步 - Add a step
+     * @param name 名称 - Name
+     * @param costBits 噪声增长的位数 - Noise growth in bits
+     * @return 步骤索引 - Step index
+     */
+    size_t addStep(const string& name, const double costBits){
+        names.push_back(name);
+        costs.push_back(costBits);
+        return names.size() - 1;
+    }
+
+    /**
+     * 计算计划 - Compute the plan
+     * @return 模数链是否足够 - Whether the modulus chain is large enough
+     */
+    bool plan(){
+        int current = int(modulusBits.size()) - 1;
+        double noiseNow = noise.fresh(modulusBits[current]);
+        double remaining = 0;
+        for(size_t i = 0; i < costs.size(); i++){
+            remaining += costs[i];
+        }
+
+        feasible = true;
+        planned.resize(costs.size());
+        noiseAfter.resize(costs.size());
+        for(size_t i = 0; i < costs.size(); i++){
+            int k = current;
+            while(k > 1 && addNoise(noiseNow, noise.floor(modulusBits[k-1])) + remaining <= -1 - marginBits){
+                k--;
+            }
+            if(k < current){
+                noiseNow = addNoise(noiseNow, noise.floor(modulusBits[k]));
+                current = k;
+            }
+            if(noiseNow + remaining > -1 - marginBits){
+                feasible = false;
+            }
+            planned[i] = current;
+            noiseNow += costs[i];
+            remaining -= costs[i];
+            noiseAfter[i] = noiseNow;
+        }
+        return feasible;
+    }
+
+    bool isFeasible() const{
+        return feasible;
+    }
+
+    // 打印计划 - Print the schedule
+    void report(ostream& os = cout) const{
+        os << "Modulus level schedule (estimated, " << marginBits << " bits margin):" << endl;
+        for(size_t i = 0; i < planned.size(); i++){
+            os << "    " << setw(2) << i << "  " << left << setw(44) << names[i] << right
+               << setw(3) << planned[i] << " primes, " << setw(4) << int(modulusBits[planned[i]]) << " bits, budget after ~"
+               << int(-noiseAfter[i] - 1) << " bits" << endl;
+        }
+        if(!feasible)
+            os << "The coefficient modulus is too small for this circuit under the noise model." << endl;
+    }
+
+    const NoiseModel& model() const{
+        return noise;
+    }
+
+private:
+    // log2(2^a + 2^b)
+    static double addNoise(const double a, const double b){
+        return max(a, b) + log2(1 + pow(2.0, -fabs(a - b)));
+    }
+
+    NoiseModel noise;
+    double marginBits;
+    vector<double> modulusBits;     // indexed by the number of data primes
+    vector<string> names;
+    vector<double> costs;
+    vector<int> planned;
+    vector<double> noiseAfter;
+    bool feasible = false;
+};
+
+/**
+ * 检测流水线的级别计划 - Level plan of the detection pipeline
+ * 步骤与PVWToBFVSeal.h和retrieval中的函数一一对应，演示打印该计划以与手动放置的切换比较
+ * The steps match the functions in PVWToBFVSeal.h and the retrieval phase; the demos print the plan for comparison with the hand-placed switches
+ * 小步和巨步被线性化：巨步的幂按照在小步之后计算来估计，这偏向保守
+ * Baby and giant steps are linearized: the giant powers are estimated as if computed after the baby steps, which errs on the safe side
+ */
+struct DetectionLevelPlan{
+    LevelPlanner planner;
+    size_t bplusAS, powers, babySteps, giantPowers, giantStep, multMany, expand, innerSum, retrieval, digest, decrypt;
+
+    /**
+     * @param context SEAL上下文 - SEAL context
+     * @param params PVW参数 - PVW parameters
+     * @param numOfTransactions 交易数量 - Number of transactions
+     * @param isRetrieval OMR(true)或OMD1p(false) - OMR (true) or OMD1p (false)
+     * @param marginBits 解密余量 - Decryption margin
+     */
+    DetectionLevelPlan(const SEALContext& context, const PVWParam& params, const int numOfTransactions, const bool isRetrieval,
+                        const double marginBits = 2)
+    : planner(context, marginBits)
+    {
+        auto& noise = planner.model();
+        size_t degree = context.key_context_data()->parms().poly_modulus_degree();
+        int tempn;
+        for(tempn = 1; tempn < params.n; tempn *= 2){}
+
+        bplusAS = planner.addStep("b - as", noise.plainMultiplication() + noise.sum(tempn) + noise.rotations());
+        powers = planner.addStep("range check powers, depth 1", noise.multiplication());
+        for(int d = 2; d <= 8; d++){
+            planner.addStep("range check powers, depth " + to_string(d), noise.multiplication());
+        }
+        babySteps = planner.addStep("range check baby steps", noise.plainMultiplication() + noise.sum(256));
+        giantPowers = planner.addStep("range check giant powers, depth 1", noise.multiplication());
+        for(int d = 2; d <= 8; d++){
+            planner.addStep("range check giant powers, depth " + to_string(d), noise.multiplication());
+        }
+        giantStep = planner.addStep("range check giant steps", noise.multiplication() + noise.sum(256));
+        multMany = planner.addStep("multiply ell results, round 1", noise.multiplication());
+        for(int r = 2; (1 << (r-1)) < params.ell; r++){
+            planner.addStep("multiply ell results, round " + to_string(r), noise.multiplication());
+        }
+        expand = innerSum = retrieval = digest = 0;
+        if(isRetrieval){
+            expand = planner.addStep("expandSIC, extract slot", noise.plainMultiplication());
+            innerSum = planner.addStep("expandSIC, innerSum", noise.sum(double(degree)) + noise.rotations());
+            retrieval = planner.addStep("index and payload retrieval", noise.plainMultiplication() + noise.sum(numOfTransactions));
+        } else {
+            digest = planner.addStep("OMD digest", noise.plainMultiplication() + noise.sum(16));
+        }
+        decrypt = planner.addStep("recipient decryption", 0);
+        planner.plan();
+    }
+};
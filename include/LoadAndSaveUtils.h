@@ -2,6 +2,7 @@
 
 // 包含必要的头文件 - Include necessary header files
 #include<iostream>
+#include<cstdio>
 #include<fstream>
 #include<string>
 #include<experimental/filesystem>
@@ -121,4 +122,33 @@ void loadClues(vector<PVWCiphertext>& clues, const int& start, const int& end, c
             clues[i-start].b[j] = temp;
         }
     }
-}
\ No newline at end of file
+}
+/**
+ * 发布公告板日志的长度 - Publish the length of the board log
+ * 线索和载荷文件是只追加的日志，写入者先写完消息的两个文件，再发布新的长度
+ * The clue and payload files form an append-only log: writers finish both files of a message first, then publish the new length
+ * 长度先写入临时文件再重命名，读取者不会看到写了一半的值 - The length goes to a temporary file that is then renamed, so readers never see half a value
+ * @param length 已提交的消息数 - Number of committed messages
+ */
+void publishLogLength(int length){
+    ofstream datafile;                                  // 输出文件流 - Output file stream
+    datafile.open ("../data/log_length.txt.tmp");       // 打开临时文件 - Open temporary file
+    datafile << length << "\n";
+    datafile.close();                                   // 关闭文件 - Close file
+    rename("../data/log_length.txt.tmp", "../data/log_length.txt");
+}
+
+/**
+ * 读取公告板日志的长度 - Load the length of the board log
+ * @return 已提交的消息数，尚未发布时为0 - Number of committed messages, 0 if nothing was published yet
+ */
+int loadLogLength(){
+    int length = 0;                                     // 日志长度 - Log length
+    ifstream datafile;                                  // 输入文件流 - Input file stream
+    datafile.open ("../data/log_length.txt");           // 打开文件 - Open file
+    if(datafile.is_open()){
+        datafile >> length;
+        datafile.close();                               // 关闭文件 - Close file
+    }
+    return length;
+}
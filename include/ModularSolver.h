@@ -0,0 +1,161 @@
+#pragma once
+
+// 包含必要的头文件 - Include necessary header files
+#include <NTL/BasicThreadPool.h>
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+/**
+ * GF(65537)上的线性代数 - Linear algebra over GF(65537)
+ * 65537 = 2^16 + 1，因此 2^16 ≡ -1：按16位分段交替相加减即可取模，无需除法，循环可以被编译器向量化
+ * 65537 = 2^16 + 1, so 2^16 ≡ -1: reducing is an alternating sum of 16-bit limbs without any division, which lets the compiler vectorize the loops
+ */
+
+// 将 x <= 2^32 + 2^16 约简到 [0, 65537)，即一个元素加上两个元素之积 - Reduce x <= 2^32 + 2^16, i.e. an element plus the product of two elements, to [0, 65537)
+inline uint32_t reduce65537(const uint64_t x){
+    uint32_t lo = uint32_t(x & 0xFFFF);
+    uint32_t hi = uint32_t(x >> 16);                    // at most 65537
+    uint32_t r = lo + 65537 - hi;                       // in [0, 2*65537)
+    return r >= 65537 ? r - 65537 : r;
+}
+
+/**
+ * 所有非零元素的逆，第一次使用时用 inv[i] = -(p/i) * inv[p%i] 在O(p)时间内计算
+ * Inverses of all non-zero elements, computed on first use in O(p) with inv[i] = -(p/i) * inv[p%i]
+ * @param a 非零元素 - Non-zero element
+ * @return a的逆 - Inverse of a
+ */
+inline uint32_t inverse65537(const uint32_t a){
+    static const vector<uint32_t> table = [](){
+        vector<uint32_t> inv(65537, 0);
+        inv[1] = 1;
+        for(uint32_t i = 2; i < 65537; i++){
+            inv[i] = uint32_t((65537 - uint64_t(65537 / i) * inv[65537 % i] % 65537) % 65537);
+        }
+        return inv;
+    }();
+    return table[a];
+}
+
+/**
+ * 一次分解、多个右侧的模65537求解器 - Factor-once, multi-RHS solver modulo 65537
+ * 对 m×k 的左侧做一次高斯-若尔当消元并记录每一步行操作，之后将这些操作批量应用到所有载荷列上
+ * Runs Gauss-Jordan elimination once on the m×k left-hand side and records every row operation, then replays the operations on all
+ * payload columns in bulk
+ * 右侧按行连续存储，每个行操作是一个可向量化的 axpy；载荷列被分块，在NTL线程池中并行处理
+ * The right-hand side is stored row-major, so every row operation is a vectorizable axpy; the payload columns are split into chunks
+ * processed in parallel on the NTL thread pool
+ */
+class ModularSolver{
+public:
+    /**
+     * 分解左侧 - Factor the left-hand side
+     * @param lhs 左侧方程组，m行k列，元素在[0, 65537) - Left-hand side, m rows and k columns, entries in [0, 65537)
+     */
+    ModularSolver(const vector<vector<int>>& lhs){
+        numOfRows = lhs.size();
+        numOfColumns = lhs.empty() ? 0 : lhs[0].size();
+        vector<vector<uint32_t>> a(numOfRows, vector<uint32_t>(numOfColumns));
+        for(size_t i = 0; i < numOfRows; i++){
+            for(size_t j = 0; j < numOfColumns; j++){
+                a[i][j] = uint32_t(lhs[i][j]);
+            }
+        }
+
+        vector<bool> used(numOfRows, false);
+        pivotRows.resize(numOfColumns);
+        pivotInverses.resize(numOfColumns);
+        for(size_t c = 0; c < numOfColumns; c++){
+            size_t p = numOfRows;
+            for(size_t i = 0; i < numOfRows && p == numOfRows; i++){
+                if(!used[i] && a[i][c] != 0)
+                    p = i;
+            }
+            if(p == numOfRows)                          // singular, nothing to solve
+                return;
+            used[p] = true;
+            pivotRows[c] = uint32_t(p);
+            pivotInverses[c] = inverse65537(a[p][c]);
+
+            for(size_t i = 0; i < numOfRows; i++){
+                if(i == p || a[i][c] == 0)
+                    continue;
+                // row_i += (p - a[i][c]/a[p][c]) * row_p
+                uint32_t factor = 65537 - reduce65537(uint64_t(a[i][c]) * pivotInverses[c]);
+                for(size_t j = c; j < numOfColumns; j++){
+                    a[i][j] = reduce65537(a[i][j] + uint64_t(factor) * a[p][j]);
+                }
+                operations.push_back({uint32_t(i), uint32_t(p), factor});
+            }
+        }
+        factoredColumns = true;
+    }
+
+    // 左侧是否列满秩 - Whether the left-hand side has full column rank
+    bool factored() const{
+        return factoredColumns;
+    }
+
+    /**
+     * 对所有载荷列求解 - Solve for all payload columns
+     * @param rhs 右侧方程组，m行 - Right-hand side, m rows
+     * @param numToSolve 要求解的载荷槽位数 - Number of payload slots to solve
+     * @param threads 并行的列块数 - Number of column chunks run in parallel
+     * @return 每个变量的解向量，长度为min(numToSolve, rhs宽度) - Solution vector per unknown, of length min(numToSolve, rhs width)
+     */
+    vector<vector<long>> solve(const vector<vector<int>>& rhs, const int numToSolve, const int threads = 1) const{
+        if(!factoredColumns || rhs.size() != numOfRows){
+            cerr << "no solution" << endl;
+            return vector<vector<long>>(0);
+        }
+        size_t width = min(size_t(max(numToSolve, 0)), rhs.empty() ? size_t(0) : rhs[0].size());
+        vector<uint32_t> b(numOfRows * width);
+        for(size_t i = 0; i < numOfRows; i++){
+            for(size_t j = 0; j < width; j++){
+                b[i*width + j] = uint32_t(rhs[i][j]);
+            }
+        }
+
+        // replay the row operations on column chunks in parallel
+        int chunks = max(1, min(threads, int(width)));
+        NTL_EXEC_RANGE(chunks, first, last);
+        for(long chunk = first; chunk < last; chunk++){
+            size_t begin = width * chunk / chunks, end = width * (chunk + 1) / chunks;
+            for(size_t o = 0; o < operations.size(); o++){
+                uint32_t* target = &b[operations[o].target * width];
+                const uint32_t* source = &b[operations[o].source * width];
+                uint64_t factor = operations[o].factor;
+                for(size_t j = begin; j < end; j++){
+                    target[j] = reduce65537(target[j] + factor * source[j]);
+                }
+            }
+        }
+        NTL_EXEC_RANGE_END;
+
+        vector<vector<long>> res(numOfColumns, vector<long>(width));
+        for(size_t c = 0; c < numOfColumns; c++){
+            const uint32_t* row = &b[pivotRows[c] * width];
+            for(size_t j = 0; j < width; j++){
+                res[c][j] = long(reduce65537(uint64_t(row[j]) * pivotInverses[c]));
+            }
+        }
+        return res;
+    }
+
+private:
+    struct RowOperation{
+        uint32_t target;    // row_target += factor * row_source
+        uint32_t source;
+        uint32_t factor;
+    };
+
+    size_t numOfRows;
+    size_t numOfColumns;
+    bool factoredColumns = false;
+    vector<uint32_t> pivotRows;
+    vector<uint32_t> pivotInverses;
+    vector<RowOperation> operations;
+};
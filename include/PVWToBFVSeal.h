@@ -5,6 +5,7 @@
 #include "seal/seal.h"
 #include <NTL/BasicThreadPool.h>
 #include "global.h"
+#include "SwitchingKeyCache.h"
 using namespace seal;
 
 /**
@@ -71,7 +72,8 @@ void innerSum_inplace(Ciphertext& output, const GaloisKeys& gal_keys, const size
 }
 
 // Takes one SIC compressed and expand then into SIC's each encrypt 0/1 in slots up to toExpandNum
-void expandSIC(vector<Ciphertext>& expanded, Ciphertext& toExpand, const GaloisKeys& gal_keys,
+// gal_keys_last are the Galois keys at the innerSum level of context2
+void expandSIC(vector<Ciphertext>& expanded, Ciphertext& toExpand, const GaloisKeys& gal_keys, const GaloisKeys& gal_keys_last,
                 const size_t& degree, const SEALContext& context, const SEALContext& context2, const size_t& toExpandNum, const size_t& start = 0){ 
     BatchEncoder batch_encoder(context);
     Evaluator evaluator(context);
@@ -101,33 +103,41 @@ void expandSIC(vector<Ciphertext>& expanded, Ciphertext& toExpand, const GaloisK
     }
 }
 
+// the j-th PVW secret vector repeated over blocks of tempn slots, the slots beyond n are 0
+void packPVWSecretKey(vector<uint64_t>& skInt, const PVWsk& regSk, const int j, const size_t& degree, const PVWParam& params){
+    int tempn = 1;
+    for(tempn = 1; tempn < params.n; tempn *= 2){}
+    skInt.resize(degree);
+    for(size_t i = 0; i < degree; i++){
+        auto tempindex = i%uint64_t(tempn);
+        if(int(tempindex) >= params.n)
+        {
+            skInt[i] = 0;
+        } else {
+            skInt[i] = uint64_t(regSk[j][tempindex].ConvertToInt() % 65537);
+        }
+    }
+}
+
 // take PVW sk's and output switching key, which is a ciphertext of size \ell*n, where n is the PVW secret key dimension
+// the ell ciphertexts are encrypted in parallel on the NTL thread pool
 void genSwitchingKeyPVWPacked(vector<Ciphertext>& switchingKey, const SEALContext& context, const size_t& degree, 
-                         const PublicKey& BFVpk, const SecretKey& BFVsk, const PVWsk& regSk, const PVWParam& params){ // TODOmulti: can be multithreaded easily
-    
+                         const PublicKey& BFVpk, const SecretKey& BFVsk, const PVWsk& regSk, const PVWParam& params){
+    switchingKey.resize(params.ell);
+    NTL_EXEC_RANGE(params.ell, first, last);
     BatchEncoder batch_encoder(context);
     Encryptor encryptor(context, BFVpk);
     // Use symmetric encryption to enable seed mode to reduce the detection key size
     encryptor.set_secret_key(BFVsk);
-
-    int tempn = 1;
-    for(tempn = 1; tempn < params.n; tempn *= 2){}
-    for(int j = 0; j < params.ell; j++){
+    vector<uint64_t> skInt;
+    Plaintext plaintext;
+    for(long j = first; j < last; j++){
         // encrypt into ell BFV ciphertexts
-        vector<uint64_t> skInt(degree);
-        for(size_t i = 0; i < degree; i++){
-            auto tempindex = i%uint64_t(tempn);
-            if(int(tempindex) >= params.n)
-            {
-                skInt[i] = 0;
-            } else {
-                skInt[i] = uint64_t(regSk[j][tempindex].ConvertToInt() % 65537);
-            }
-        }
-        Plaintext plaintext;
+        packPVWSecretKey(skInt, regSk, int(j), degree, params);
         batch_encoder.encode(skInt, plaintext);
         encryptor.encrypt_symmetric(plaintext, switchingKey[j]);
     }
+    NTL_EXEC_RANGE_END;
 }
 
 // This is the same as the function above but with a return type, for detection key size calculation
@@ -139,19 +149,9 @@ vector<seal::Serializable<Ciphertext>> genSwitchingKeyPVWPacked(const SEALContex
     Encryptor encryptor(context, BFVpk);
     encryptor.set_secret_key(BFVsk);
 
-    int tempn = 1;
-    for(tempn = 1; tempn < params.n; tempn *= 2){}
+    vector<uint64_t> skInt;
     for(int j = 0; j < params.ell; j++){
-        vector<uint64_t> skInt(degree);
-        for(size_t i = 0; i < degree; i++){
-            auto tempindex = i%uint64_t(tempn);
-            if(int(tempindex) >= params.n)
-            {
-                skInt[i] = 0;
-            } else {
-                skInt[i] = uint64_t(regSk[j][tempindex].ConvertToInt() % 65537);
-            }
-        }
+        packPVWSecretKey(skInt, regSk, j, degree, params);
         Plaintext plaintext;
         batch_encoder.encode(skInt, plaintext);
         switchingKey.push_back(encryptor.encrypt_symmetric(plaintext));
@@ -160,10 +160,51 @@ vector<seal::Serializable<Ciphertext>> genSwitchingKeyPVWPacked(const SEALContex
     return switchingKey;
 }
 
+// Packed-components layout: component l of the j-th clue lives in slot l*(degree/ell) + j, so one ciphertext holds all ell components
+// The switching key rotates by up to tempn-1 slots within a block, so a batch fits if it has at most degree/ell - tempn + 1 clues
+// ell needs to be a power of 2 so that the blocks can be folded together by rotations in newRangeCheckPVWPackedComponents
+bool canPackPVWComponents(const size_t& numOfClues, const size_t& degree, const PVWParam& params){
+    if(params.ell < 2 || (params.ell & (params.ell - 1)) != 0)
+        return false;
+    int tempn;
+    for(tempn = 1; tempn < params.n; tempn *= 2){}
+    return numOfClues + tempn <= degree/params.ell + 1;
+}
+
+// all ell PVW secret vectors, s_l repeated over block l of degree/ell slots
+void packPVWSecretKeyComponents(vector<uint64_t>& skInt, const PVWsk& regSk, const size_t& degree, const PVWParam& params){
+    int tempn = 1;
+    for(tempn = 1; tempn < params.n; tempn *= 2){}
+    size_t blockSize = degree/params.ell;
+    skInt.assign(degree, 0);
+    for(size_t i = 0; i < blockSize*params.ell; i++){
+        auto tempindex = (i%blockSize)%uint64_t(tempn);
+        if(int(tempindex) < params.n)
+        {
+            skInt[i] = uint64_t(regSk[i/blockSize][tempindex].ConvertToInt() % 65537);
+        }
+    }
+}
+
+// switching key for the packed-components layout: a single ciphertext with s_l repeated over block l
+void genSwitchingKeyPVWPackedComponents(Ciphertext& switchingKey, const SEALContext& context, const size_t& degree, 
+                         const PublicKey& BFVpk, const SecretKey& BFVsk, const PVWsk& regSk, const PVWParam& params){
+    BatchEncoder batch_encoder(context);
+    Encryptor encryptor(context, BFVpk);
+    encryptor.set_secret_key(BFVsk);
+
+    vector<uint64_t> skInt;
+    packPVWSecretKeyComponents(skInt, regSk, degree, params);
+    Plaintext plaintext;
+    batch_encoder.encode(skInt, plaintext);
+    encryptor.encrypt_symmetric(plaintext, switchingKey);
+}
+
 
 // compute b - as with packed swk but also only requires one rot key
+// the rotated switching keys come from the cache, so a batch does no key switching for the rotations held by the cache
 void computeBplusASPVWOptimized(vector<Ciphertext>& output, \
-        const vector<PVWCiphertext>& toPack, vector<Ciphertext>& switchingKey, const GaloisKeys& gal_keys,
+        const vector<PVWCiphertext>& toPack, const RotatedSwitchingKeyCache& switchingKeyCache,
         const SEALContext& context, const PVWParam& param){ 
     MemoryPoolHandle my_pool = MemoryPoolHandle::New(true);
     auto old_prof = MemoryManager::SwitchProfile(std::make_unique<MMProfFixed>(std::move(my_pool)));
@@ -176,9 +217,11 @@ void computeBplusASPVWOptimized(vector<Ciphertext>& output, \
     size_t slot_count = batch_encoder.slot_count();
     if(toPack.size() > slot_count){
         cerr << "Please pack at most " << slot_count << " PVW ciphertexts at one time." << endl;
+        MemoryManager::SwitchProfile(std::move(old_prof));
         return;
     }
 
+    vector<Ciphertext> scratch(param.ell);
     for(int i = 0; i < tempn; i++){
         vector<uint64_t> vectorOfInts(toPack.size());
         for(size_t j = 0; j < toPack.size(); j++){
@@ -195,16 +238,16 @@ void computeBplusASPVWOptimized(vector<Ciphertext>& output, \
         batch_encoder.encode(vectorOfInts, plaintext);
         
         for(int j = 0; j < param.ell; j++){
+            // switching key rotated by i slots
+            const Ciphertext& rotatedKey = switchingKeyCache.get(i, j, scratch[j]);
             if(i == 0){
-                evaluator.multiply_plain(switchingKey[j], plaintext, output[j]); // times s[i]
+                evaluator.multiply_plain(rotatedKey, plaintext, output[j]); // times s[i]
             }
             else{
                 Ciphertext temp;
-                evaluator.multiply_plain(switchingKey[j], plaintext, temp);
+                evaluator.multiply_plain(rotatedKey, plaintext, temp);
                 evaluator.add_inplace(output[j], temp);
             }
-            // rotate one slot at a time
-            evaluator.rotate_rows_inplace(switchingKey[j], 1, gal_keys);
         }
     }
 
@@ -224,6 +267,77 @@ void computeBplusASPVWOptimized(vector<Ciphertext>& output, \
     MemoryManager::SwitchProfile(std::move(old_prof));
 }
 
+// without a cache, rotate one slot at a time as we go; the switching keys themselves are left untouched
+void computeBplusASPVWOptimized(vector<Ciphertext>& output, \
+        const vector<PVWCiphertext>& toPack, const vector<Ciphertext>& switchingKey, const GaloisKeys& gal_keys,
+        const SEALContext& context, const PVWParam& param){ 
+    RotatedSwitchingKeyCache switchingKeyCache(switchingKey, gal_keys, context, param);
+    computeBplusASPVWOptimized(output, toPack, switchingKeyCache, context, param);
+}
+
+// compute b - as in the packed-components layout, all ell components end up in one ciphertext
+// same number of plaintext multiplications and rotations as computeBplusASPVWOptimized, divided by ell
+void computeBplusASPVWPackedComponents(Ciphertext& output, \
+        const vector<PVWCiphertext>& toPack, const Ciphertext& switchingKey, const GaloisKeys& gal_keys,
+        const SEALContext& context, const PVWParam& param){ 
+    int tempn;
+    for(tempn = 1; tempn < param.n; tempn*=2){}
+
+    Evaluator evaluator(context);
+    BatchEncoder batch_encoder(context);
+    size_t slot_count = batch_encoder.slot_count();
+    if(!canPackPVWComponents(toPack.size(), slot_count, param)){
+        cerr << "Please pack at most " << slot_count/param.ell - tempn + 1 << " PVW ciphertexts at one time in the packed-components layout." << endl;
+        return;
+    }
+    size_t blockSize = slot_count/param.ell;
+
+    MemoryPoolHandle my_pool = MemoryPoolHandle::New(true);
+    auto old_prof = MemoryManager::SwitchProfile(std::make_unique<MMProfFixed>(std::move(my_pool)));
+
+    vector<uint64_t> vectorOfInts(slot_count, 0);
+    Plaintext plaintext;
+    Ciphertext rotatedKey;
+    for(int i = 0; i < tempn; i++){
+        for(size_t j = 0; j < toPack.size(); j++){
+            int the_index = (i+int(j))%tempn;
+            uint64_t a = 0;
+            if(the_index < param.n)
+                a = uint64_t((toPack[j].a[the_index].ConvertToInt()));
+            // every block multiplies the same a with its own s_l
+            for(int l = 0; l < param.ell; l++){
+                vectorOfInts[l*blockSize + j] = a;
+            }
+        }
+        batch_encoder.encode(vectorOfInts, plaintext);
+
+        if(i == 0){
+            evaluator.multiply_plain(switchingKey, plaintext, output); // times s[i]
+            // rotate one slot at a time
+            evaluator.rotate_rows(switchingKey, 1, gal_keys, rotatedKey);
+        }
+        else{
+            Ciphertext temp;
+            evaluator.multiply_plain(rotatedKey, plaintext, temp);
+            evaluator.add_inplace(output, temp);
+            if(i+1 < tempn)
+                evaluator.rotate_rows_inplace(rotatedKey, 1, gal_keys);
+        }
+    }
+
+    fill(vectorOfInts.begin(), vectorOfInts.end(), 0);
+    for(int l = 0; l < param.ell; l++){
+        for(size_t j = 0; j < toPack.size(); j++){
+            vectorOfInts[l*blockSize + j] = uint64_t((toPack[j].b[l].ConvertToInt() - 16384) % 65537); 
+        }
+    }
+    batch_encoder.encode(vectorOfInts, plaintext);
+    evaluator.negate_inplace(output);
+    evaluator.add_plain_inplace(output, plaintext);
+    evaluator.mod_switch_to_next_inplace(output); 
+    MemoryManager::SwitchProfile(std::move(old_prof));
+}
+
 inline
 void calUptoDegreeK(vector<Ciphertext>& output, const Ciphertext& input, const int DegreeK, const RelinKeys &relin_keys, const SEALContext& context){
     vector<int> calculated(DegreeK, 0);
@@ -421,4 +535,49 @@ void newRangeCheckPVW(vector<Ciphertext>& output, const int& range, const RelinK
     // Multiply them to reduce the false positive rate
     EvalMultMany_inpace(res, relin_keys, context);
     output = res;
+}
+
+// rotation steps used by newRangeCheckPVWPackedComponents, 0 stands for the column rotation
+vector<int> packedComponentsRotationSteps(const size_t& degree, const PVWParam& param){
+    vector<int> steps = {0};
+    for(size_t step = degree/4; step >= degree/param.ell; step /= 2){
+        steps.push_back(int(step));
+    }
+    return steps;
+}
+
+// range check in the packed-components layout: a single range check for all ell components
+// then fold block l onto block 0 with log(ell) rotations, multiplying as we go, which uses the same levels as EvalMultMany_inpace
+// gal_keys_packed has packedComponentsRotationSteps in context_packed, the level-specific context at the range check output level
+void newRangeCheckPVWPackedComponents(Ciphertext& output, const int& range, const RelinKeys &relin_keys, const GaloisKeys& gal_keys_packed,
+                        const size_t& degree, const SEALContext& context, const SEALContext& context_packed, const PVWParam& param){
+    Evaluator evaluator(context);
+    Evaluator evaluator_packed(context_packed);
+
+    Ciphertext res;
+    {
+        MemoryPoolHandle my_pool_larger = MemoryPoolHandle::New(true);
+        auto old_prof_larger = MemoryManager::SwitchProfile(std::make_unique<MMProfFixed>(std::move(my_pool_larger)));
+        auto tmp1 = output;
+        // first use range check to obtain 0 and 1
+        RangeCheck_PatersonStockmeyer(res, tmp1, 65537, degree, relin_keys, context);
+        tmp1.release();
+        MemoryManager::SwitchProfile(std::move(old_prof_larger));
+    }
+
+    // Multiply the blocks together to reduce the false positive rate
+    int counter = 0;
+    for(size_t step = degree/2; step >= degree/param.ell; step /= 2){
+        counter += 1;
+        Ciphertext rotated;
+        if(step == degree/2)
+            evaluator_packed.rotate_columns(res, gal_keys_packed, rotated);
+        else
+            evaluator_packed.rotate_rows(res, int(step), gal_keys_packed, rotated);
+        evaluator.multiply_inplace(res, rotated);
+        evaluator.relinearize_inplace(res, relin_keys);
+        if(counter & 1)
+            evaluator.mod_switch_to_next_inplace(res);
+    }
+    output = res;
 }
\ No newline at end of file
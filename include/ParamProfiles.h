@@ -0,0 +1,184 @@
+#pragma once
+
+// 包含必要的头文件 - Include necessary header files
+#include "regevEncryption.h"
+#include "seal/seal.h"
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace seal;
+
+// BFV参数配置 - BFV parameter profiles
+// The detection circuit consumes a fixed number of data primes for the PVW parameters in use:
+//      1 for b - as, 8 for the range check (two calUptoDegreeK up to 256, 4 switches each),
+//      ceil(ceil(log2(ell))/2) for EvalMultMany_inpace,
+//      and then 3 primes for OMD1p (digest) or 4 primes for OMR (expandSIC switches twice, innerSum at the last 2)
+// With PVW q = 65537 and ell = 4 this is 13 (OMD1p) or 14 (OMR) primes. 8192 and 16384 only allow 218 and 438 bits at
+// 128-bit security, i.e. 5 and 7 primes, so only 32768 is feasible until the detection circuit gets shallower
+// (e.g. a lower-degree range check or a smaller ell); profiles for smaller degrees belong here together with such a circuit.
+struct OMRParamProfile{
+    string name;
+    size_t poly_modulus_degree;
+    vector<int> coeff_modulus_bits; // 数据素数，最后一个是特殊素数 - data primes, the last one is the special prime
+    int next_primes;                // gal_keys_next所在子上下文保留的数据素数 - data primes kept by the sub-context of gal_keys_next
+    int last_primes;                // gal_keys_last所在子上下文保留的数据素数 - data primes kept by the sub-context of gal_keys_last
+    bool retrieval;                 // OMR(true)或仅OMD1p(false) - OMR (true) or OMD1p only (false)
+    OMRParamProfile(string name, size_t poly_modulus_degree, vector<int> coeff_modulus_bits, int next_primes, int last_primes, bool retrieval)
+    : name(name), poly_modulus_degree(poly_modulus_degree), coeff_modulus_bits(coeff_modulus_bits),
+      next_primes(next_primes), last_primes(last_primes), retrieval(retrieval)
+    {}
+};
+
+/**
+ * 所有已审核的参数配置 - All vetted parameter profiles
+ * @return 参数配置向量 - Vector of parameter profiles
+ */
+vector<OMRParamProfile> omrParamProfiles(){
+    vector<OMRParamProfile> profiles;
+    profiles.push_back(OMRParamProfile("OMD-32768", 32768, { 28,
+                                                                            39, 60, 60, 60,
+                                                                            60, 60, 60, 60, 60, 60,
+                                                                            32, 30, 60 }, 0, 0, false));
+    profiles.push_back(OMRParamProfile("OMR-32768", 32768, { 28,
+                                                                            39, 60, 60, 60, 60,
+                                                                            60, 60, 60, 60, 60, 60,
+                                                                            32, 30, 60 }, 4, 2, true));
+    return profiles;
+}
+
+/**
+ * 检测电路需要的数据素数数量 - Number of data primes needed by the detection circuit
+ * @param params PVW参数 - PVW parameters
+ * @param retrieval 是否为OMR - Whether OMR
+ * @return 数据素数数量，不支持时返回-1 - Number of data primes, -1 if not supported
+ */
+int requiredDataPrimes(const PVWParam& params, const bool retrieval){
+    if(params.q != 65537){ // the range check polynomial (rangeCheckIndices) is only available for q = 65537
+        return -1;
+    }
+    int multManyRounds = int(ceil(log2(params.ell)));
+    return 1 + 8 + (multManyRounds+1)/2 + (retrieval ? 4 : 3);
+}
+
+/**
+ * 范围检查输出所在级别的数据素数数量 - Number of data primes left at the range check output
+ * 打包分量布局的旋转密钥在该级别生成 - Rotation keys of the packed-components layout are generated at this level
+ * @param profile 参数配置 - Parameter profile
+ * @return 数据素数数量 - Number of data primes
+ */
+int rangeCheckOutputPrimes(const OMRParamProfile& profile){
+    return int(profile.coeff_modulus_bits.size()) - 1 - 1 - 8; // minus the special prime, b - as and the range check
+}
+
+/**
+ * 查表取出该模式的参数配置并检查 - Look up the parameter profile of the mode in the table and check it
+ * 表中每种模式目前只有一个配置（见上文），检查保证它仍满足 - The table currently has one profile per mode (see above), the checks make sure it still meets
+ *      1. 128位安全 - 128-bit security for the total coefficient modulus
+ *      2. 足够的数据素数 - Enough data primes for the detection circuit
+ *      3. 2*kbar个桶，每个桶payloadSize个槽位 - 2*kbar buckets of payloadSize slots each (OMR only)
+ * @param kbar 相关消息数量上界 - Bound on the number of pertinent messages
+ * @param payloadSize 载荷大小 - Payload size
+ * @param retrieval 是否为OMR - Whether OMR
+ * @param params PVW参数 - PVW parameters
+ * @param verbose 是否打印被拒绝的原因 - Whether to print why profiles are rejected
+ * @return 选中的参数配置 - Selected parameter profile
+ * @throws invalid_argument 没有配置满足要求时 - If no profile meets the requirements
+ */
+OMRParamProfile selectParamProfile(const int kbar, const int payloadSize, const bool retrieval, const PVWParam& params,
+                                    const bool verbose = true){
+    auto profiles = omrParamProfiles();
+    int required = requiredDataPrimes(params, retrieval);
+
+    for(size_t i = 0; i < profiles.size(); i++){
+        auto& profile = profiles[i];
+        if(profile.retrieval != retrieval){
+            continue;
+        }
+        int totalBits = 0;
+        for(size_t j = 0; j < profile.coeff_modulus_bits.size(); j++){
+            totalBits += profile.coeff_modulus_bits[j];
+        }
+        int dataPrimes = int(profile.coeff_modulus_bits.size()) - 1;
+
+        string reason;
+        if(totalBits > CoeffModulus::MaxBitCount(profile.poly_modulus_degree, sec_level_type::tc128)){
+            reason = "coefficient modulus exceeds the 128-bit security bound";
+        } else if(required < 0 || dataPrimes < required){
+            reason = "needs " + to_string(required) + " data primes, has " + to_string(dataPrimes);
+        } else if(retrieval && size_t(2*kbar*payloadSize) > profile.poly_modulus_degree){
+            reason = "2*kbar*payloadSize = " + to_string(2*kbar*payloadSize) + " slots do not fit";
+        }
+
+        if(reason.empty()){
+            if(verbose)
+                cout << "Selected parameter profile " << profile.name << endl;
+            return profile;
+        }
+        if(verbose)
+            cout << "Parameter profile " << profile.name << " rejected: " << reason << endl;
+    }
+
+    throw invalid_argument("no parameter profile fits kbar = " + to_string(kbar) + " and payloadSize = " + to_string(payloadSize));
+}
+
+/**
+ * 参数配置对应的BFV加密参数 - BFV encryption parameters of a profile
+ * 使用带种子的PRNG，以便密钥可以以种子模式保存 - Uses a seeded PRNG so that keys can be saved in seed mode
+ * @param profile 参数配置 - Parameter profile
+ * @return 加密参数 - Encryption parameters
+ */
+EncryptionParameters profileEncryptionParameters(const OMRParamProfile& profile){
+    EncryptionParameters parms(scheme_type::bfv);
+    parms.set_poly_modulus_degree(profile.poly_modulus_degree);
+    parms.set_coeff_modulus(CoeffModulus::Create(profile.poly_modulus_degree, profile.coeff_modulus_bits));
+    parms.set_plain_modulus(65537);
+
+    prng_seed_type seed;
+    for (auto &i : seed)
+    {
+        i = random_uint64();
+    }
+    auto rng = make_shared<Blake2xbPRNGFactory>(Blake2xbPRNGFactory(seed));
+    parms.set_random_generator(rng);
+    return parms;
+}
+
+/**
+ * 级别特定的子上下文 - Level-specific sub-context
+ * 保留前numPrimes个数据素数和特殊素数，其参数ID与主上下文对应级别一致
+ * Keeps the first numPrimes data primes and the special prime, so its levels share parms_id with the main context
+ * @param parms 主上下文的加密参数 - Encryption parameters of the main context
+ * @param numPrimes 保留的数据素数数量 - Number of data primes kept
+ * @return 子上下文 - Sub-context
+ */
+SEALContext levelSpecificContext(const EncryptionParameters& parms, const int numPrimes){
+    vector<Modulus> coeff_modulus = parms.coeff_modulus();
+    coeff_modulus.erase(coeff_modulus.begin() + numPrimes, coeff_modulus.end()-1);
+    EncryptionParameters parms_level = parms;
+    parms_level.set_coeff_modulus(coeff_modulus);
+    return SEALContext(parms_level, true, sec_level_type::none);
+}
+
+/**
+ * 主私钥在级别特定子上下文中的限制 - Restriction of the main secret key to a level-specific sub-context
+ * @param secret_key 主私钥 - Main secret key
+ * @param context 主上下文 - Main context
+ * @param context_level 子上下文 - Sub-context
+ * @return 子上下文的私钥 - Secret key of the sub-context
+ */
+SecretKey levelSpecificSecretKey(const SecretKey& secret_key, const SEALContext& context, const SEALContext& context_level){
+    size_t degree = context.key_context_data()->parms().poly_modulus_degree();
+    size_t fullSize = context.key_context_data()->parms().coeff_modulus().size();
+    size_t levelSize = context_level.key_context_data()->parms().coeff_modulus().size();
+
+    SecretKey sk_level;
+    sk_level.data().resize(levelSize * degree);
+    sk_level.parms_id() = context_level.key_parms_id();
+    util::set_poly(secret_key.data().data(), degree, levelSize - 1, sk_level.data().data());
+    util::set_poly(
+        secret_key.data().data() + degree * (fullSize - 1), degree, 1,
+        sk_level.data().data() + degree * (levelSize - 1));
+    return sk_level;
+}
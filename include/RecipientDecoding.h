@@ -0,0 +1,243 @@
+#pragma once
+
+// 包含必要的头文件 - Include necessary header files
+#include "CompactDigest.h"
+#include "client.h"
+#include "seal/seal.h"
+#include <sys/resource.h>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <vector>
+using namespace seal;
+
+/**
+ * 轻量的接收者解码 - Lightweight recipient decoding
+ * 不依赖检测者的全局状态（global.h、二分图映射、伽罗瓦密钥），也不需要完整的14素数上下文：
+ * 接收者只构建摘要所在级别的上下文，加载私钥在该级别的限制和一个自描述的摘要文件，然后解码索引和载荷
+ * Does not depend on the detector's global state (global.h, the bipartite map, Galois keys), nor on the full 14-prime context:
+ * the recipient only builds the context of the digest's level, loads the restriction of its secret key to that level and a
+ * self-describing digest file, then decodes the indices and payloads
+ * 桶和权重由(seed, 索引)导出，见BucketAssignment.h - Buckets and weights are derived from (seed, index), see BucketAssignment.h
+ */
+
+/**
+ * 自描述的摘要 - Self-describing digest
+ * 确定性编码（OMR2）使用lhs，随机化编码（OMR3）使用lhsRandom和lhsCounter
+ * The deterministic encoding (OMR2) uses lhs, the randomized encoding (OMR3) uses lhsRandom and lhsCounter
+ */
+struct RecipientDigest{
+    bool randomized = false;
+    int numOfTransactions = 0;              // 范围查询时为范围长度 - The range length for range queries
+    int indexBase = 0;                      // 范围查询的起始消息 - First message of a range query
+    int num_of_buckets = 0;
+    int repetition = 0;
+    int seed = 0;
+    int payloadSize = 306;
+    Ciphertext rhs;
+    vector<Ciphertext> lhs;                 // 索引块 - Index blocks
+    vector<vector<Ciphertext>> lhsRandom;   // 每组的高位（可选）和低位 - Optional high and low part per group
+    vector<Ciphertext> lhsCounter;          // 每组的计数器 - Counter per group
+};
+
+/**
+ * 接收者上下文 - Recipient context
+ * 只保留前numPrimes个数据素数，不含特殊素数，因此唯一的级别与主上下文中numPrimes个素数的级别有相同的参数ID
+ * Keeps only the first numPrimes data primes and no special prime, so its single level shares parms_id with the level of the main
+ * context that has numPrimes primes
+ * @param parms 主上下文的加密参数 - Encryption parameters of the main context
+ * @param numPrimes 摘要所在级别的素数数量 - Number of primes at the digest's level
+ * @return 接收者上下文 - Recipient context
+ */
+SEALContext recipientContext(const EncryptionParameters& parms, const int numPrimes){
+    vector<Modulus> coeff_modulus = parms.coeff_modulus();
+    coeff_modulus.resize(numPrimes);
+    EncryptionParameters parms_level = parms;
+    parms_level.set_coeff_modulus(coeff_modulus);
+    return SEALContext(parms_level, false, sec_level_type::none);
+}
+
+/**
+ * 主私钥在接收者上下文中的限制 - Restriction of the main secret key to the recipient context
+ * 由接收者生成一次后保存，之后解码不再需要主上下文 - Derived once and saved by the recipient, decoding no longer needs the main context afterwards
+ * @param secret_key 主私钥 - Main secret key
+ * @param context 主上下文 - Main context
+ * @param context_recipient 接收者上下文 - Recipient context
+ * @return 接收者上下文的私钥 - Secret key of the recipient context
+ */
+SecretKey recipientSecretKey(const SecretKey& secret_key, const SEALContext& context, const SEALContext& context_recipient){
+    size_t degree = context.key_context_data()->parms().poly_modulus_degree();
+    size_t levelSize = context_recipient.key_context_data()->parms().coeff_modulus().size();
+
+    SecretKey sk_level;
+    sk_level.data().resize(levelSize * degree);
+    sk_level.parms_id() = context_recipient.key_parms_id();
+    util::set_poly(secret_key.data().data(), degree, levelSize, sk_level.data().data());
+    return sk_level;
+}
+
+/**
+ * 保存自描述的摘要 - Save a self-describing digest
+ * 格式 - Format: randomized | numOfTransactions | indexBase | num_of_buckets | repetition | seed | payloadSize | 块数或组数 - number of blocks or groups |
+ *      每组的部分数（仅随机化）- parts per group (randomized only) | 紧凑格式的rhs和各块 - rhs and the blocks in the compact format
+ * @param digest 摘要 - Digest
+ * @param context 摘要所属的上下文 - Context of the digest
+ * @param noiseBudget 摘要的噪声预算（位）- Noise budget of the digest in bits
+ * @param stream 输出流 - Output stream
+ * @return 写入的字节数 - Number of bytes written
+ */
+streamoff saveRecipientDigest(const RecipientDigest& digest, const SEALContext& context, const double noiseBudget, ostream& stream){
+    uint8_t randomized = digest.randomized ? 1 : 0;
+    stream.write(reinterpret_cast<const char*>(&randomized), 1);
+    int32_t header[7] = {digest.numOfTransactions, digest.indexBase, digest.num_of_buckets, digest.repetition, digest.seed, digest.payloadSize,
+                        int32_t(digest.randomized ? digest.lhsCounter.size() : digest.lhs.size())};
+    stream.write(reinterpret_cast<const char*>(header), sizeof(header));
+    streamoff written = 1 + sizeof(header);
+    if(digest.randomized){
+        for(size_t i = 0; i < digest.lhsRandom.size(); i++){
+            uint8_t parts = uint8_t(digest.lhsRandom[i].size());
+            stream.write(reinterpret_cast<const char*>(&parts), 1);
+            written += 1;
+        }
+    }
+
+    written += saveCompactDigest(digest.rhs, context, noiseBudget, stream);
+    if(digest.randomized){
+        for(size_t i = 0; i < digest.lhsRandom.size(); i++){
+            for(size_t w = 0; w < digest.lhsRandom[i].size(); w++){
+                written += saveCompactDigest(digest.lhsRandom[i][w], context, noiseBudget, stream);
+            }
+            written += saveCompactDigest(digest.lhsCounter[i], context, noiseBudget, stream);
+        }
+    } else {
+        for(size_t k = 0; k < digest.lhs.size(); k++){
+            written += saveCompactDigest(digest.lhs[k], context, noiseBudget, stream);
+        }
+    }
+    return written;
+}
+
+/**
+ * 读取自描述的摘要 - Load a self-describing digest
+ * @param digest 输出摘要 - Output digest
+ * @param context 接收者上下文 - Recipient context
+ * @param stream 输入流 - Input stream
+ * @return 是否成功 - Whether successful
+ */
+bool loadRecipientDigest(RecipientDigest& digest, const SEALContext& context, istream& stream){
+    uint8_t randomized = 0;
+    stream.read(reinterpret_cast<char*>(&randomized), 1);
+    int32_t header[7];
+    stream.read(reinterpret_cast<char*>(header), sizeof(header));
+    if(!stream){
+        cerr << "The digest header is truncated." << endl;
+        return false;
+    }
+    digest.randomized = randomized != 0;
+    digest.numOfTransactions = header[0];
+    digest.indexBase = header[1];
+    digest.num_of_buckets = header[2];
+    digest.repetition = header[3];
+    digest.seed = header[4];
+    digest.payloadSize = header[5];
+    size_t blocks = size_t(header[6]);
+
+    digest.lhs.clear();
+    digest.lhsRandom.clear();
+    digest.lhsCounter.clear();
+    if(digest.randomized){
+        digest.lhsRandom.resize(blocks);
+        digest.lhsCounter.resize(blocks);
+        for(size_t i = 0; i < blocks; i++){
+            uint8_t parts = 0;
+            stream.read(reinterpret_cast<char*>(&parts), 1);
+            digest.lhsRandom[i].resize(parts);
+        }
+    } else {
+        digest.lhs.resize(blocks);
+    }
+
+    loadCompactDigest(digest.rhs, context, stream);
+    for(size_t i = 0; i < digest.lhsRandom.size(); i++){
+        for(size_t w = 0; w < digest.lhsRandom[i].size(); w++){
+            loadCompactDigest(digest.lhsRandom[i][w], context, stream);
+        }
+        loadCompactDigest(digest.lhsCounter[i], context, stream);
+    }
+    for(size_t k = 0; k < digest.lhs.size(); k++){
+        loadCompactDigest(digest.lhs[k], context, stream);
+    }
+    if(!stream || digest.rhs.size() == 0){
+        cerr << "The digest could not be loaded into this context." << endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * 解码摘要 - Decode a digest
+ * @param pertinentIndices 输出的相关索引映射 - Output pertinent indices map
+ * @param digest 摘要 - Digest
+ * @param secret_key 接收者上下文的私钥 - Secret key of the recipient context
+ * @param context 接收者上下文 - Recipient context
+ * @param threads 解密和求解的线程数 - Threads for decryption and solving
+ * @return 每条相关消息的载荷，与receiverDecoding相同 - Payload per pertinent message, same as receiverDecoding
+ */
+vector<vector<long>> recipientDecode(map<int, int>& pertinentIndices, const RecipientDigest& digest, const SecretKey& secret_key,
+                                    const SEALContext& context, const int threads = 1){
+    size_t degree = context.first_context_data()->parms().poly_modulus_degree();
+
+    // 1. 查找相关索引 - Find pertinent indices
+    pertinentIndices.clear();
+    if(digest.randomized)
+        decodeIndicesRandom(pertinentIndices, digest.lhsRandom, digest.lhsCounter, degree, secret_key, context, digest.indexBase);
+    else
+        decodeIndices(pertinentIndices, digest.lhs, digest.numOfTransactions, degree, secret_key, context, digest.indexBase);
+
+    // 2. 构建右侧方程 - Forming right-hand side
+    vector<vector<int>> rhs;
+    formRhs(rhs, digest.rhs, secret_key, degree, context, digest.num_of_buckets, digest.payloadSize);
+
+    // 3. 只为相关消息构建左侧方程 - Forming left-hand side for the pertinent messages only
+    vector<vector<int>> lhs;
+    formLhsWeights(lhs, pertinentIndices, digest.num_of_buckets, digest.repetition, digest.seed);
+
+    // 4. 求解方程 - Solving equation
+    return peelingEquationSolving(lhs, rhs, digest.payloadSize, threads);
+}
+
+/**
+ * 为独立的接收者程序保存参数、私钥和摘要 - Save the parameters, secret key and digest for the standalone recipient program
+ * 写入../data/recipient_parms.bin、recipient_sk.bin和recipient_digest.bin - Writes ../data/recipient_parms.bin, recipient_sk.bin and recipient_digest.bin
+ * @param digest 摘要，在主上下文中 - Digest, in the main context
+ * @param parms 主上下文的加密参数 - Encryption parameters of the main context
+ * @param secret_key 主私钥 - Main secret key
+ * @param context 主上下文 - Main context
+ * @param noiseBudget 摘要的噪声预算（位）- Noise budget of the digest in bits
+ * @return 摘要的字节数 - Number of bytes of the digest
+ */
+streamoff saveRecipientBundle(const RecipientDigest& digest, const EncryptionParameters& parms, const SecretKey& secret_key,
+                            const SEALContext& context, const double noiseBudget){
+    int numPrimes = int(context.get_context_data(digest.rhs.parms_id())->parms().coeff_modulus().size());
+    SEALContext context_recipient = recipientContext(parms, numPrimes);
+
+    ofstream parmsFile("../data/recipient_parms.bin", ios::binary);
+    context_recipient.key_context_data()->parms().save(parmsFile);
+    ofstream skFile("../data/recipient_sk.bin", ios::binary);
+    recipientSecretKey(secret_key, context, context_recipient).save(skFile);
+    ofstream digestFile("../data/recipient_digest.bin", ios::binary);
+    return saveRecipientDigest(digest, context, noiseBudget, digestFile);
+}
+
+// 进程的峰值常驻内存（KB）- Peak resident memory of the process in KB
+long peakRSSKilobytes(){
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+#ifdef __APPLE__
+    return long(usage.ru_maxrss / 1024);   // bytes on macOS
+#else
+    return long(usage.ru_maxrss);
+#endif
+}
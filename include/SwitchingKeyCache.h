@@ -0,0 +1,188 @@
+#pragma once
+
+// 包含必要的头文件 - Include necessary header files
+#include "regevEncryption.h"
+#include "seal/seal.h"
+#include <fcntl.h>
+#include <fstream>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+using namespace seal;
+
+/**
+ * 旋转切换密钥缓存 - Rotated switching key cache
+ * computeBplusASPVWOptimized 对每一批线索都将 ell 个切换密钥旋转 tempn-1 次，这些旋转只依赖接收者的密钥
+ * computeBplusASPVWOptimized rotates the ell switching keys tempn-1 times for every batch, and these rotations only depend on the recipient's keys
+ * 内存/吞吐量权衡 - Memory/throughput knob:
+ *      前inMemoryRotations个旋转保存在内存中（每个旋转占ell个完整级别的密文）
+ *      the first inMemoryRotations rotations are kept in memory (ell full-level ciphertexts per rotation),
+ *      其余的写入spillPath并通过mmap读取，spillPath为空时在线计算
+ *      the rest are spilled to spillPath and read back through mmap, or computed on the fly if spillPath is empty
+ * inMemoryRotations = 1 时不复制任何密文，等同于不使用缓存 - inMemoryRotations = 1 copies nothing, same as not caching at all
+ * 原始切换密钥和伽罗瓦密钥不被复制，需要比缓存存活更久 - The switching keys and Galois keys are not copied and must outlive the cache
+ */
+class RotatedSwitchingKeyCache{
+public:
+    /**
+     * 构造缓存并预计算旋转 - Build the cache and precompute the rotations
+     * @param switchingKey 切换密钥 - Switching keys
+     * @param gal_keys 包含步长1的伽罗瓦密钥 - Galois keys with step 1
+     * @param context SEAL上下文 - SEAL context
+     * @param params PVW参数 - PVW parameters
+     * @param inMemoryRotations 内存中保存的旋转数（包括第0个）- Rotations kept in memory (including the 0-th)
+     * @param spillPath 溢出文件路径 - Spill file path
+     */
+    RotatedSwitchingKeyCache(const vector<Ciphertext>& switchingKey, const GaloisKeys& gal_keys, const SEALContext& context,
+                            const PVWParam& params, const int inMemoryRotations = 1, const string& spillPath = "")
+    : switchingKey(&switchingKey), gal_keys(&gal_keys), context(context), evaluator(context), ell(params.ell)
+    {
+        for(tempn = 1; tempn < params.n; tempn *= 2){}
+        this->inMemoryRotations = max(1, min(inMemoryRotations, tempn));
+        rotations.resize(this->inMemoryRotations - 1, vector<Ciphertext>(ell));
+        bool spill = !spillPath.empty() && this->inMemoryRotations < tempn;
+
+        ofstream spillFile;
+        if(spill){
+            spillFile.open(spillPath, ios::binary | ios::trunc);
+            if(spillFile.is_open()){
+                this->spillPath = spillPath;
+                spillOffsets.push_back(0);
+            } else {
+                cerr << "Cannot create " << spillPath << ", the spilled rotations are computed on the fly." << endl;
+                spill = false;
+            }
+        }
+        vector<Ciphertext> current(ell);
+        for(int i = 1; i < tempn; i++){
+            if(i >= this->inMemoryRotations && !spill)
+                break;
+            for(int j = 0; j < ell; j++){
+                if(i == 1)
+                    evaluator.rotate_rows(switchingKey[j], 1, gal_keys, current[j]);
+                else
+                    evaluator.rotate_rows_inplace(current[j], 1, gal_keys);
+
+                if(i < this->inMemoryRotations){
+                    rotations[i-1][j] = current[j];
+                } else {
+                    // no compression, loading back should be a plain copy
+                    try{
+                        spillOffsets.push_back(spillOffsets.back() + current[j].save(spillFile, compr_mode_type::none));
+                    } catch(const exception& e){
+                        cerr << "Cannot write " << spillPath << " (" << e.what() << "), the spilled rotations are computed on the fly." << endl;
+                        spill = false;
+                        spillOffsets.clear();
+                        removeSpill();
+                        break;
+                    }
+                }
+            }
+        }
+
+        if(spill){
+            spillFile.close();
+            if(!spillFile){
+                cerr << "Cannot write " << spillPath << ", the spilled rotations are computed on the fly." << endl;
+                spillOffsets.clear();
+                removeSpill();
+                return;
+            }
+            spillFd = open(spillPath.c_str(), O_RDONLY);
+            spillSize = size_t(spillOffsets.back());
+            void* mapped = spillFd < 0 ? MAP_FAILED : mmap(nullptr, spillSize, PROT_READ, MAP_SHARED, spillFd, 0);
+            if(mapped == MAP_FAILED){
+                cerr << "Cannot map " << spillPath << ", the spilled rotations are computed on the fly." << endl;
+                spillOffsets.clear();
+                removeSpill();
+            } else {
+                spillData = static_cast<const seal_byte*>(mapped);
+            }
+        }
+    }
+
+    RotatedSwitchingKeyCache(const RotatedSwitchingKeyCache&) = delete;
+    RotatedSwitchingKeyCache& operator=(const RotatedSwitchingKeyCache&) = delete;
+
+    ~RotatedSwitchingKeyCache(){
+        if(spillData)
+            munmap(const_cast<seal_byte*>(spillData), spillSize);
+        removeSpill();
+    }
+
+    /**
+     * 第rotation次旋转后的第j个切换密钥 - The j-th switching key rotated by `rotation` slots
+     * 对每个j，rotation需要从0开始递增调用，scratch在调用之间保存在线旋转的状态
+     * For each j, call with rotation increasing from 0; scratch keeps the state of on-the-fly rotations between calls
+     * 不同线程使用各自的scratch时可以并发调用 - Safe to call concurrently with a scratch per thread
+     * @param rotation 旋转次数 - Number of rotations
+     * @param j 切换密钥索引 - Switching key index
+     * @param scratch 临时密文 - Scratch ciphertext
+     * @return 旋转后的切换密钥 - Rotated switching key
+     */
+    const Ciphertext& get(const int rotation, const int j, Ciphertext& scratch) const{
+        if(rotation == 0)
+            return (*switchingKey)[j];
+        if(rotation < inMemoryRotations)
+            return rotations[rotation-1][j];
+        if(spillData){
+            size_t k = size_t(rotation - inMemoryRotations)*ell + j;
+            scratch.load(context, spillData + spillOffsets[k], size_t(spillOffsets[k+1] - spillOffsets[k]));
+            return scratch;
+        }
+        if(rotation == inMemoryRotations)
+            evaluator.rotate_rows(get(rotation-1, j, scratch), 1, *gal_keys, scratch);
+        else
+            evaluator.rotate_rows_inplace(scratch, 1, *gal_keys);
+        return scratch;
+    }
+
+    // 旋转总数 - Total number of rotations
+    int numOfRotations() const{
+        return tempn;
+    }
+
+    // 包含步长1的伽罗瓦密钥 - Galois keys with step 1
+    const GaloisKeys& galoisKeys() const{
+        return *gal_keys;
+    }
+
+    /**
+     * 内存预算内可缓存的旋转数 - Number of rotations that fit into a memory budget
+     * @param memoryBudget 内存预算（字节）- Memory budget in bytes
+     * @param context SEAL上下文 - SEAL context
+     * @param params PVW参数 - PVW parameters
+     * @return 旋转数，至少为1 - Number of rotations, at least 1
+     */
+    static int rotationsWithinBudget(const size_t memoryBudget, const SEALContext& context, const PVWParam& params){
+        auto& parms = context.first_context_data()->parms();
+        size_t bytesPerRotation = size_t(params.ell) * 2 * parms.coeff_modulus().size() * parms.poly_modulus_degree() * sizeof(uint64_t);
+        return max(1, int(memoryBudget/bytesPerRotation) + 1); // the 0-th rotation is the switching key itself
+    }
+
+private:
+    // 关闭并删除溢出文件 - Close and delete the spill file
+    void removeSpill(){
+        if(spillFd >= 0)
+            close(spillFd);
+        spillFd = -1;
+        if(!spillPath.empty())
+            unlink(spillPath.c_str());
+        spillPath.clear();
+    }
+
+    const vector<Ciphertext>* switchingKey;
+    const GaloisKeys* gal_keys;
+    SEALContext context;
+    Evaluator evaluator;
+    int ell;
+    int tempn;
+    int inMemoryRotations;
+    vector<vector<Ciphertext>> rotations;   // rotations 1 ... inMemoryRotations-1
+    vector<streamoff> spillOffsets;         // offsets of rotations inMemoryRotations ... tempn-1 in the spill file
+    string spillPath;                       // empty when nothing was spilled
+    int spillFd = -1;
+    size_t spillSize = 0;
+    const seal_byte* spillData = nullptr;
+};
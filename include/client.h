@@ -1,12 +1,43 @@
 #pragma once
 
 // 包含必要的头文件 - Include necessary header files
+#include "BucketAssignment.h"
+#include "ModularSolver.h"
 #include "seal/seal.h"
+#include <NTL/BasicThreadPool.h>
 #include <algorithm>
 #include <map>
 
 using namespace seal;
-#define PROFILE
+
+/**
+ * 并行解密并解码一组密文 - Decrypt and decode a list of ciphertexts in parallel
+ * 在NTL线程池上按范围划分，每个范围使用自己的解密器；空指针和空密文被跳过
+ * Split into ranges on the NTL thread pool, each range with its own decryptor; null pointers and empty ciphertexts are skipped
+ * @param decoded 解码结果，缓冲区在多次调用间复用 - Decoded slots, the buffers are reused across calls
+ * @param cts 密文 - Ciphertexts
+ * @param degree 多项式度数 - Polynomial degree
+ * @param secret_key 私钥 - Secret key
+ * @param context SEAL上下文 - SEAL context
+ */
+void decryptAndDecode(vector<vector<uint64_t>>& decoded, const vector<const Ciphertext*>& cts, const size_t& degree,
+                        const SecretKey& secret_key, const SEALContext& context){
+    decoded.resize(cts.size());
+    for(size_t i = 0; i < cts.size(); i++){
+        decoded[i].resize(degree);
+    }
+    NTL_EXEC_RANGE(long(cts.size()), first, last);
+    Decryptor decryptor(context, secret_key);           // 每个范围一个解密器 - One decryptor per range
+    BatchEncoder batch_encoder(context);                // 批编码器 - Batch encoder
+    Plaintext plain_result;                             // 明文结果 - Plaintext result
+    for(long i = first; i < last; i++){
+        if(!cts[i] || cts[i]->size() == 0)
+            continue;
+        decryptor.decrypt(*cts[i], plain_result);
+        batch_encoder.decode(plain_result, decoded[i]);
+    }
+    NTL_EXEC_RANGE_END;
+}
 
 /**
  * OMD的确定性解码 - Deterministic decoding for OMD
@@ -26,24 +57,38 @@ vector<uint64_t> decodeIndicesOMD(const Ciphertext& indexPack, const int& num_of
     decryptor.decrypt(indexPack, plain_result);         // 解密索引包 - Decrypt index pack
     batch_encoder.decode(plain_result, indexPackint);   // 解码明文 - Decode plaintext
 
-    uint64_t counter = 0;                               // 计数器 - Counter
-    // 遍历所有度数 - Iterate through all degrees
+    // 第i个槽位的第b位代表消息b*degree + i，只访问置位的位 - Bit b of slot i stands for message b*degree + i, only the set bits are visited
     for(size_t i = 0; i < degree; i++){
-        if(indexPackint[i]){                            // 如果索引包不为零 - If index pack is non-zero
-            if(indexPackint[i] & 1){                    // 检查最低位 - Check lowest bit
-                pertinentIndices.push_back(counter*degree + i); // 添加相关索引 - Add pertinent index
-            }
-            indexPackint[i] >>= 1;                      // 右移一位 - Right shift by one
-            counter += 1;                               // 增加计数器 - Increment counter
-            i--;                                        // 回退一位 - Decrement i
-        } else {
-            counter = 0;                                // 重置计数器 - Reset counter
+        for(uint64_t word = indexPackint[i]; word; word &= word - 1){
+            uint64_t b = uint64_t(__builtin_ctzll(word)); // 最低的置位 - Lowest set bit
+            pertinentIndices.push_back(b*degree + i);   // 添加相关索引 - Add pertinent index
         }
     }
 
     return pertinentIndices;                            // 返回相关索引 - Return pertinent indices
 }
 
+/**
+ * 扫描解码后的确定性索引包 - Scan a decoded deterministic index pack
+ * 第idx个槽位的第b位代表消息16*idx + b，用ctz只访问置位的位 - Bit b of slot idx stands for message 16*idx + b, ctz visits only the set bits
+ * @param pertinentIndices 相关索引映射，编号接着已有的索引 - Pertinent indices map, numbered after the indices already in it
+ * @param indexPackint 解码后的槽位 - Decoded slots
+ * @param num_of_transactions 交易数量 - Number of transactions
+ * @param indexBase 索引相对于它编码 - Indices are encoded relative to it
+ */
+void scanIndexPack(map<int, int>& pertinentIndices, const vector<uint64_t>& indexPackint, const int& num_of_transactions, const int indexBase = 0){
+    int counter = int(pertinentIndices.size());         // 计数器，接着之前的块 - Counter, continuing previous blocks
+    size_t slots = min(indexPackint.size(), size_t((num_of_transactions + 15) / 16));
+    for(size_t idx = 0; idx < slots; idx++){
+        for(uint64_t word = indexPackint[idx]; word; word &= word - 1){
+            int i = int(16*idx) + __builtin_ctzll(word); // 最低的置位 - Lowest set bit
+            if(i >= num_of_transactions)
+                break;
+            pertinentIndices.insert(pair<int, int>(i + indexBase, counter++)); // 插入相关索引 - Insert pertinent index
+        }
+    }
+}
+
 /**
  * OMR的确定性解码 - Deterministic decoding for OMR
  * OMD的确定性编码更高效，但对整体性能影响有限 - The deterministic encoding for OMD is more efficient, but has limited affect on the overall performance
@@ -53,74 +98,73 @@ vector<uint64_t> decodeIndicesOMD(const Ciphertext& indexPack, const int& num_of
  * @param degree 多项式度数 - Polynomial degree
  * @param secret_key 私钥 - Secret key
  * @param context SEAL上下文 - SEAL context
+ * @param indexBase 范围查询的起始消息，索引相对于它编码 - First message of a range query, indices are encoded relative to it
  */
-void decodeIndices(map<int, int>& pertinentIndices, const Ciphertext& indexPack, const int& num_of_transactions, const size_t& degree, const SecretKey& secret_key, const SEALContext& context){
-    Decryptor decryptor(context, secret_key);           // 解密器 - Decryptor
-    BatchEncoder batch_encoder(context);                // 批编码器 - Batch encoder
-    vector<uint64_t> indexPackint(degree);              // 索引包整数 - Index pack integers
-    Plaintext plain_result;                             // 明文结果 - Plaintext result
-    decryptor.decrypt(indexPack, plain_result);         // 解密索引包 - Decrypt index pack
-    batch_encoder.decode(plain_result, indexPackint);   // 解码明文 - Decode plaintext
-    int counter = 0;                                    // 计数器 - Counter
-    int backcounter = 16;                               // 回退计数器 - Back counter
-    int idx = 0;                                        // 索引 - Index
-    // 遍历所有交易 - Iterate through all transactions
-    for(int i = 0; i < num_of_transactions;){
-        if(!indexPackint[idx])                          // 如果索引包为零 - If index pack is zero
-        {
-            idx += 1;                                   // 增加索引 - Increment index
-            i += backcounter;                           // 跳过回退计数器个位置 - Skip back counter positions
-            backcounter = 16;                           // 重置回退计数器 - Reset back counter
-            continue;
-        }
-        if(indexPackint[idx]&1)                         // 检查该位是否为1 - Check if that slot is 1
-        {
-            pertinentIndices.insert(pair<int, int>(i, counter++)); // 插入相关索引 - Insert pertinent index
-        }
-        indexPackint[idx] >>= 1;                        // 右移一位 - Right shift by one
-        backcounter -= 1;                               // 减少回退计数器 - Decrement back counter
-        i++;                                            // 增加交易索引 - Increment transaction index
-    }
+void decodeIndices(map<int, int>& pertinentIndices, const Ciphertext& indexPack, const int& num_of_transactions, const size_t& degree, const SecretKey& secret_key, const SEALContext& context,
+                    const int indexBase = 0){
+    vector<vector<uint64_t>> indexPackint;              // 索引包整数 - Index pack integers
+    decryptAndDecode(indexPackint, {&indexPack}, degree, secret_key, context);
+    scanIndexPack(pertinentIndices, indexPackint[0], num_of_transactions, indexBase);
 }
 
 /**
- * OMR的随机化解码 - Randomized decoding for OMR
+ * 多块的确定性解码 - Deterministic decoding over index blocks
+ * 第k块保存从indexBase + k*16*degree开始的消息，空块没有相关消息
+ * Block k holds the messages from indexBase + k*16*degree on, empty blocks have no pertinent messages
  * @param pertinentIndices 相关索引映射 - Pertinent indices map
- * @param indexPack 索引包密文向量 - Index pack ciphertext vector
- * @param indexCounter 索引计数器 - Index counter
+ * @param indexPack 索引块 - Index blocks
+ * @param num_of_transactions 交易数量 - Number of transactions
  * @param degree 多项式度数 - Polynomial degree
  * @param secret_key 私钥 - Secret key
  * @param context SEAL上下文 - SEAL context
+ * @param indexBase 范围查询的起始消息 - First message of a range query
  */
-void decodeIndicesRandom(map<int, int>& pertinentIndices, const vector<vector<Ciphertext>>& indexPack, const vector<Ciphertext>& indexCounter,
-                                     const size_t& degree, const SecretKey& secret_key, const SEALContext& context){
-    Decryptor decryptor(context, secret_key);           // 解密器 - Decryptor
-    BatchEncoder batch_encoder(context);                // 批编码器 - Batch encoder
+void decodeIndices(map<int, int>& pertinentIndices, const vector<Ciphertext>& indexPack, const int& num_of_transactions, const size_t& degree, const SecretKey& secret_key, const SEALContext& context,
+                    const int indexBase = 0){
+    int blockSize = int(16*degree);
+    vector<const Ciphertext*> blocks;
+    for(size_t k = 0; k < indexPack.size() && int(k)*blockSize < num_of_transactions; k++){
+        blocks.push_back(&indexPack[k]);
+    }
+    vector<vector<uint64_t>> indexPackint;              // 并行解密所有块 - Decrypt all blocks in parallel
+    decryptAndDecode(indexPackint, blocks, degree, secret_key, context);
+    for(size_t k = 0; k < blocks.size(); k++){
+        if(blocks[k]->size() == 0)
+            continue;
+        scanIndexPack(pertinentIndices, indexPackint[k], min(blockSize, num_of_transactions - int(k)*blockSize), indexBase + int(k)*blockSize);
+    }
+}
 
+/**
+ * 扫描解码后的随机化索引包 - Scan decoded randomized index packs
+ * 每组依次为计数器、高位和低位的解码结果 - Counter, high and low part decoded per group
+ * @param pertinentIndices 相关索引映射 - Pertinent indices map
+ * @param decoded 每组3个解码结果，共3*C个 - 3 decoded slot vectors per group, 3*C in total
+ * @param hasHigh 每组是否有高位部分，少于65537条消息的范围不发送 - Whether each group has a high part, ranges of fewer than 65537 messages do not send it
+ * @param degree 多项式度数 - Polynomial degree
+ * @param indexBase 范围查询的起始消息，索引相对于它编码 - First message of a range query, indices are encoded relative to it
+ * @return 是否找到了计数器给出的所有消息 - Whether all the messages given by the counters were found
+ */
+bool scanIndexPackRandom(map<int, int>& pertinentIndices, const vector<vector<uint64_t>>& decoded, const vector<bool>& hasHigh,
+                        const size_t& degree, const int indexBase = 0){
     int counter = 0;                                    // 计数器 - Counter
     int realNumOfPertinentMsg = 0;                      // 实际相关消息数量 - Real number of pertinent messages
-    vector<uint64_t> countertemp(degree);               // 临时计数器 - Temporary counter
-    Plaintext plain_result;                             // 明文结果 - Plaintext result
-    decryptor.decrypt(indexCounter[0], plain_result);   // 解密第一个索引计数器 - Decrypt first index counter
-    batch_encoder.decode(plain_result, countertemp);    // 解码明文 - Decode plaintext
+    vector<uint64_t> zeros(degree, 0);                  // 没有高位部分时 - Without a high part
+
     // 首先累加计数器以查看有多少消息 - First sum up the counters to see how many messages are there
     for(size_t i = 0; i < degree; i++){
-        realNumOfPertinentMsg += countertemp[i];
+        realNumOfPertinentMsg += decoded[0][i];
     }
 
     // 遍历所有索引计数器 - Iterate through all index counters
-    for(size_t i = 0; i < indexCounter.size(); i++){
-        vector<uint64_t> plain_counter(degree), plain_one(degree), plain_two(degree); // 明文计数器和两个明文向量 - Plain counter and two plain vectors
-        decryptor.decrypt(indexCounter[i], plain_result);
-        batch_encoder.decode(plain_result, plain_counter);
-        decryptor.decrypt(indexPack[i][0], plain_result);
-        batch_encoder.decode(plain_result, plain_one);
-        decryptor.decrypt(indexPack[i][1], plain_result);
-        batch_encoder.decode(plain_result, plain_two);
+    for(size_t i = 0; i < hasHigh.size(); i++){
+        const vector<uint64_t>& plain_counter = decoded[3*i];
+        const vector<uint64_t>& plain_one = hasHigh[i] ? decoded[3*i+1] : zeros;
+        const vector<uint64_t>& plain_two = decoded[3*i+2];
         // 检查每个度数位置 - Check each degree position
         for(size_t j = 0; j < degree; j++){
             if(plain_counter[j] == 1){                  // 检查无冲突的槽位 - Check the slots without collision
-                uint64_t index = plain_one[j]*65537 + plain_two[j]; // 计算索引 - Calculate index
+                uint64_t index = plain_one[j]*65537 + plain_two[j] + indexBase; // 计算索引 - Calculate index
                 if(pertinentIndices.find(index) == pertinentIndices.end()){ // 如果索引不存在 - If index doesn't exist
                     pertinentIndices.insert(pair<int, int>(index, counter++)); // 插入新索引 - Insert new index
                 }
@@ -129,13 +173,62 @@ void decodeIndicesRandom(map<int, int>& pertinentIndices, const vector<vector<Ci
         if(counter == realNumOfPertinentMsg)            // 如果找到所有相关消息 - If all pertinent messages found
             break;
     }
-    if(counter != realNumOfPertinentMsg)                // 如果计数器不匹配 - If counter doesn't match
+    return counter == realNumOfPertinentMsg;
+}
+
+/**
+ * OMR的随机化解码 - Randomized decoding for OMR
+ * @param pertinentIndices 相关索引映射 - Pertinent indices map
+ * @param indexPack 索引包密文向量 - Index pack ciphertext vector
+ * @param indexCounter 索引计数器 - Index counter
+ * @param degree 多项式度数 - Polynomial degree
+ * @param secret_key 私钥 - Secret key
+ * @param context SEAL上下文 - SEAL context
+ * @param indexBase 范围查询的起始消息，索引相对于它编码 - First message of a range query, indices are encoded relative to it
+ */
+void decodeIndicesRandom(map<int, int>& pertinentIndices, const vector<vector<Ciphertext>>& indexPack, const vector<Ciphertext>& indexCounter,
+                                     const size_t& degree, const SecretKey& secret_key, const SEALContext& context, const int indexBase = 0){
+    // 并行解密所有3*C个密文，每组依次为计数器、高位和低位 - Decrypt all 3*C ciphertexts in parallel, counter, high and low part for each group
+    // 少于65537条消息的范围不发送高位部分 - Ranges of fewer than 65537 messages do not send the high part
+    vector<const Ciphertext*> cts;
+    vector<bool> hasHigh(indexCounter.size());
+    for(size_t i = 0; i < indexCounter.size(); i++){
+        hasHigh[i] = indexPack[i].size() == 2;
+        cts.push_back(&indexCounter[i]);
+        cts.push_back(hasHigh[i] ? &indexPack[i][0] : nullptr);
+        cts.push_back(&indexPack[i].back());
+    }
+    vector<vector<uint64_t>> decoded;                   // 解码结果 - Decoded slots
+    decryptAndDecode(decoded, cts, degree, secret_key, context);
+
+    if(!scanIndexPackRandom(pertinentIndices, decoded, hasHigh, degree, indexBase)) // 如果计数器不匹配 - If counter doesn't match
     {
         cerr << "Overflow" << endl;                     // 输出溢出错误 - Output overflow error
         exit(1);
     }
 }
 
+/**
+ * 从解码后的载荷槽位构建方程的右侧 - Construct the RHS of the equations from the decoded payload slots
+ * @param rhs 右侧方程组 - Right-hand side equations
+ * @param rhsint 解码后的打包载荷 - Decoded packed payloads
+ * @param num_of_buckets 桶的数量 - Number of buckets
+ * @param payloadSlots 载荷槽位数 - Number of payload slots
+ */
+void formRhs(vector<vector<int>>& rhs, const vector<uint64_t>& rhsint, const int num_of_buckets = 64, const int payloadSlots = 306){
+    rhs.resize(num_of_buckets);                         // 调整右侧大小 - Resize RHS
+    // 初始化所有桶 - Initialize all buckets
+    for(int i = 0; i < num_of_buckets; i++){
+        rhs[i].resize(payloadSlots, 0);
+    }
+    // 填充右侧数据 - Fill RHS data
+    for(int i = 0; i < num_of_buckets; i++){
+        for(int j = 0; j < payloadSlots; j++){
+            rhs[i][j] = int(rhsint[i*payloadSlots + j]);
+        }
+    }
+}
+
 /**
  * 构建方程的右侧 - Construct the RHS of the equations
  * @param rhs 右侧方程组 - Right-hand side equations
@@ -154,18 +247,7 @@ void formRhs(vector<vector<int>>& rhs, const Ciphertext& packedPayloads, const S
     Plaintext plain_result;                             // 明文结果 - Plaintext result
     decryptor.decrypt(packedPayloads, plain_result);    // 解密打包载荷 - Decrypt packed payloads
     batch_encoder.decode(plain_result, rhsint);         // 解码明文 - Decode plaintext
-
-    rhs.resize(num_of_buckets);                         // 调整右侧大小 - Resize RHS
-    // 初始化所有桶 - Initialize all buckets
-    for(int i = 0; i < num_of_buckets; i++){
-        rhs[i].resize(payloadSlots, 0);
-    }
-    // 填充右侧数据 - Fill RHS data
-    for(int i = 0; i < num_of_buckets; i++){
-        for(int j = 0; j < payloadSlots; j++){
-            rhs[i][j] = int(rhsint[i*payloadSlots + j]);
-        }
-    }
+    formRhs(rhs, rhsint, num_of_buckets, payloadSlots);
 }
 
 /**
@@ -198,6 +280,27 @@ void formLhsWeights(vector<vector<int>>& lhs, map<int, int>& pertinentIndices, c
 }
 
 
+/**
+ * 构建方程的左侧，只为相关消息导出桶和权重 - Construct the LHS of the equations, deriving buckets and weights for the pertinent messages only
+ * 内存和时间与公告板大小无关 - Memory and time do not depend on the board size
+ * @param lhs 左侧方程组 - Left-hand side equations
+ * @param pertinentIndices 相关索引映射 - Pertinent indices map
+ * @param num_of_buckets 桶的数量 - Number of buckets
+ * @param repetition 每条消息的桶数 - Buckets per message
+ * @param seed 检测者使用的种子 - Seed used by the detector
+ */
+void formLhsWeights(vector<vector<int>>& lhs, map<int, int>& pertinentIndices, const int num_of_buckets, const int repetition, const int seed){
+    lhs.assign(num_of_buckets, vector<int>(pertinentIndices.size(), 0));
+    vector<int> buckets, weights;                       // 一条消息的桶和权重 - Buckets and weights of one message
+    for(auto itr = pertinentIndices.begin(); itr != pertinentIndices.end(); ++itr){
+        bucketsOf(buckets, weights, uint64_t(itr->first), num_of_buckets, repetition, seed);
+        for(size_t j = 0; j < buckets.size(); j++){
+            lhs[buckets[j]][itr->second] = weights[j];
+        }
+    }
+}
+
+
 /////////////////////////// 方程求解相关函数 - For equation solving
 
 /**
@@ -319,52 +422,116 @@ vector<long> singleSolve(const long& a, const vector<int>& toSolve, long mod = 6
 }
 
 /**
- * 使用上述函数执行高斯消元 - Performs Gaussian elimination using the functions above
+ * 高斯消元求解 - Solve by Gaussian elimination
+ * 左侧只分解一次，然后由ModularSolver一起应用到所有载荷槽位 - The left-hand side is factored once, then ModularSolver applies it to all payload slots together
  * @param lhs 左侧方程组 - Left-hand side equations
  * @param rhs 右侧方程组 - Right-hand side equations
  * @param numToSolve 要求解的数量 - Number to solve
+ * @param threads 求解载荷槽位的线程数 - Threads solving the payload slots
  * @return 返回解向量 - Returns solution vectors
  */
-vector<vector<long>> equationSolving(vector<vector<int>>& lhs, vector<vector<int>>& rhs, const int& numToSolve = 306){
-    vector<int> recoder(lhs[0].size(), -1);             // 记录器 - Recorder
-    size_t counter = 0;                                 // 计数器 - Counter
-    int rcd = 0;                                        // 记录值 - Recorded value
-
-    // 高斯消元的前向消除阶段 - Forward elimination phase of Gaussian elimination
-    while(counter < recoder.size()){
-        // 寻找主元 - Find pivot
-        for(size_t i = 0; i < lhs.size(); i++){
-            if (lhs[i][counter] != 0){                  // 如果元素非零 - If element is non-zero
-                if(find(recoder.begin(), recoder.end(), int(i)) != recoder.end()){ // 如果行已使用 - If row already used
-                    continue;
-                }
-                recoder[counter] = i;                   // 记录主元行 - Record pivot row
-                rcd = lhs[i][counter];                  // 记录主元值 - Record pivot value
-                break;
+vector<vector<long>> equationSolving(vector<vector<int>>& lhs, vector<vector<int>>& rhs, const int& numToSolve = 306, const int threads = 1){
+    ModularSolver solver(lhs);                          // 分解左侧 - Factor the left-hand side
+    if(!solver.factored()){                             // 如果没有找到主元 - If no pivot found
+        cerr << "no solution" << endl;                 // 无解 - No solution
+        return vector<vector<long>>(0);
+    }
+    return solver.solve(rhs, numToSolve, threads);      // 求解所有载荷槽位 - Solve all payload slots
+}
+
+/**
+ * 剥离求解 - Peeling solver
+ * 每条消息只在repeatition_glb个桶中，方程组是稀疏的：只剩一个未解变量的行可以直接求解，然后从该变量所在的其他行中消去
+ * Every message sits in only repeatition_glb buckets, so the system is sparse: a row with a single unsolved column is solved directly,
+ * and the column is then eliminated from the other rows it appears in
+ * 剥离停止后，只对剩余的核心调用equationSolving - Once peeling stalls, equationSolving only runs on the residual core
+ * 每行记录未解列的个数和列索引之和，个数为1时和即为该列 - Each row keeps the count and the index sum of its unsolved columns, with a count of 1 the sum is that column
+ * @param lhs 左侧方程组，会被修改 - Left-hand side equations, modified
+ * @param rhs 右侧方程组，会被修改 - Right-hand side equations, modified
+ * @param numToSolve 要求解的数量 - Number to solve
+ * @param threads 求解剩余核心的线程数 - Threads solving the residual core
+ * @return 返回解向量，与equationSolving相同 - Returns solution vectors, same as equationSolving
+ */
+vector<vector<long>> peelingEquationSolving(vector<vector<int>>& lhs, vector<vector<int>>& rhs, const int& numToSolve = 306, const int threads = 1){
+    size_t numOfColumns = lhs.empty() ? 0 : lhs[0].size();
+    vector<vector<int>> rowsOf(numOfColumns);           // 每列出现的行 - Rows each column appears in
+    vector<int> unsolvedInRow(lhs.size(), 0);           // 每行未解的列数 - Unsolved columns per row
+    vector<size_t> columnSum(lhs.size(), 0);            // 每行未解列的索引之和 - Index sum of the unsolved columns per row
+    for(size_t i = 0; i < lhs.size(); i++){
+        for(size_t j = 0; j < numOfColumns; j++){
+            if(lhs[i][j] != 0){
+                rowsOf[j].push_back(int(i));
+                unsolvedInRow[i]++;
+                columnSum[i] += j;
             }
         }
-        if(recoder[counter] == -1){                     // 如果没有找到主元 - If no pivot found
-            cerr << "no solution" << endl;             // 无解 - No solution
-            return vector<vector<long>>(0);
-        }
-        // 消除其他行 - Eliminate other rows
-        for(size_t i = 0; i < lhs.size(); i++){
-            if ((lhs[i][counter] != 0) && (lhs[i][counter] != rcd)) // 如果需要消除 - If elimination needed
-            {
-                int k = -1;                             // 比率系数 - Ratio coefficient
-                get_ratio_mult_and_subtract(lhs[i], lhs[recoder[counter]], counter, numToSolve, k);
-                get_ratio_mult_and_subtract(rhs[i], rhs[recoder[counter]], counter, numToSolve, k);
+    }
+
+    vector<vector<long>> res(numOfColumns);             // 结果向量 - Result vector
+    vector<bool> solved(numOfColumns, false);
+    vector<int> ready;                                  // 只剩一个未解列的行 - Rows with a single unsolved column
+    for(size_t i = 0; i < lhs.size(); i++){
+        if(unsolvedInRow[i] == 1)
+            ready.push_back(int(i));
+    }
+
+    // 剥离 - Peeling
+    while(!ready.empty()){
+        int r = ready.back();
+        ready.pop_back();
+        if(unsolvedInRow[r] != 1)                       // 已被其他行解出 - Solved through another row meanwhile
+            continue;
+        size_t j = columnSum[r];
+        res[j] = singleSolve(lhs[r][j], rhs[r]);
+        solved[j] = true;
+
+        for(size_t t = 0; t < rowsOf[j].size(); t++){
+            int r2 = rowsOf[j][t];
+            if(lhs[r2][j] != 0 && r2 != r){
+                long k = lhs[r2][j];
+                int limit = min(numToSolve, int(rhs[r2].size()));
+                for(int c = 0; c < limit; c++){
+                    long temp = (rhs[r2][c] - k*res[j][c]) % 65537;
+                    rhs[r2][c] = int(temp < 0 ? temp + 65537 : temp);
+                }
             }
+            lhs[r2][j] = 0;
+            unsolvedInRow[r2]--;
+            columnSum[r2] -= j;
+            if(unsolvedInRow[r2] == 1)
+                ready.push_back(r2);
         }
-        counter++;                                      // 增加计数器 - Increment counter
     }
 
-    // 回代求解 - Back substitution
-    vector<vector<long>> res(recoder.size());           // 结果向量 - Result vector
-    counter = 0;
-    for(size_t i = 0; i < recoder.size(); i++){
-        res[i] = singleSolve(lhs[recoder[counter]][counter], rhs[recoder[counter]]); // 求解单个方程 - Solve single equation
-        counter++;
+    // 剩余核心的高斯消元 - Gaussian elimination on the residual core
+    vector<int> coreColumns;
+    for(size_t j = 0; j < numOfColumns; j++){
+        if(!solved[j])
+            coreColumns.push_back(int(j));
     }
-    return res;                                         // 返回结果 - Return result
-}
\ No newline at end of file
+    if(coreColumns.empty())
+        return res;
+
+    vector<vector<int>> coreLhs, coreRhs;
+    for(size_t i = 0; i < lhs.size(); i++){
+        if(unsolvedInRow[i] == 0)
+            continue;
+        vector<int> row(coreColumns.size());
+        for(size_t c = 0; c < coreColumns.size(); c++){
+            row[c] = lhs[i][coreColumns[c]];
+        }
+        coreLhs.push_back(row);
+        coreRhs.push_back(rhs[i]);
+    }
+    if(coreLhs.empty()){
+        cerr << "no solution" << endl;                 // 无解 - No solution
+        return vector<vector<long>>(0);
+    }
+    auto coreRes = equationSolving(coreLhs, coreRhs, numToSolve, threads);
+    if(coreRes.empty())
+        return coreRes;
+    for(size_t c = 0; c < coreColumns.size(); c++){
+        res[coreColumns[c]] = coreRes[c];
+    }
+    return res;
+}
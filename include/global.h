@@ -17,6 +17,9 @@ size_t C_glb = 5;                                    // 全局C参数 - Global C
 int numOfTransactions_glb = 1<<19;                   // 全局交易数量 - Global number of transactions
 size_t poly_modulus_degree_glb = 32768;              // 全局多项式模数度 - Global polynomial modulus degree
 size_t num_of_pertinent_msgs_glb = 50;               // 全局相关消息数量 - Global number of pertinent messages
+size_t switchingKeyCacheBytes_glb = 0;               // 切换密钥旋转缓存的内存预算（字节），0为不缓存 - Memory budget of the switching key rotation cache in bytes, 0 for no cache
+string switchingKeyCacheSpill_glb = "";              // 其余旋转的溢出文件，空则在线计算 - Spill file for the other rotations, empty to compute them on the fly
+bool compactDigestMeasuredBudget_glb = false;        // 紧凑摘要是否按接收者测量的噪声预算舍去低位，否则只按位打包 - Whether compact digests drop low bits by the recipient-measured noise budget, otherwise bit-pack only
 vector<uint64_t> expectedIndices;                   // 预期索引 - Expected indices
 
 // 预计算的索引 - Precomputed indices
@@ -3,6 +3,9 @@
 #include "math/ternaryuniformgenerator.h"
 #include "math/discreteuniformgenerator.h"
 #include "math/discretegaussiangenerator.h"
+#include "FlatLWE.h"
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
 using namespace std;
 using namespace lbcrypto;
@@ -105,24 +108,6 @@ void regevDec(int& msg, const regevCiphertext& ct, const regevSK& sk, const rege
 /////////////////////////////////////////// PVW
 ///////////////////////////////////////////////////////////
 
-struct PVWParam{
-    int n;
-    int q;
-    double std_dev;
-    int m;
-    int ell;
-    PVWParam(){
-        n = 450;
-        q = 65537;
-        std_dev = 1.3;
-        m = 16000; 
-        ell = 4;
-    }
-    PVWParam(int n, int q, double std_dev, int m, int ell)
-    : n(n), q(q), std_dev(std_dev), m(m), ell(ell)
-    {}
-};
-
 typedef vector<NativeVector> PVWsk;
 
 struct PVWCiphertext{
@@ -135,55 +120,121 @@ typedef vector<PVWCiphertext> PVWpk;
 PVWsk PVWGenerateSecretKey(const PVWParam& param);
 PVWpk PVWGeneratePublicKey(const PVWParam& param, const PVWsk& sk);
 void PVWEncSK(PVWCiphertext& ct, const vector<int>& msg, const PVWsk& sk, const PVWParam& param, const bool& pk_gen = false);
+void PVWEncSK(PVWCiphertext& ct, const vector<int>& msg, const FlatPVWsk& sk, const PVWParam& param, const bool& pk_gen = false);
 void PVWEncPK(PVWCiphertext& ct, const vector<int>& msg, const PVWpk& pk, const PVWParam& param);
 void PVWDec(vector<int>& msg, const PVWCiphertext& ct, const PVWsk& sk, const PVWParam& param);
+void PVWDec(vector<int>& msg, const PVWCiphertext& ct, const FlatPVWsk& sk, const PVWParam& param);
 
 /////////////////////////////////////////////////////////////////// Below are implementation
 
-PVWsk PVWGenerateSecretKey(const PVWParam& param){
-    int n = param.n;
-    int q = param.q;
-    lbcrypto::DiscreteUniformGeneratorImpl<regevSK> dug;
-    dug.SetModulus(q);
-    PVWsk ret(param.ell);
-    for(int i = 0; i < param.ell; i++){
-        ret[i] = dug.GenerateVector(n);
+// conversions between the flat arrays of FlatLWE.h and NativeVector
+
+FlatPVWsk toFlatPVWsk(const PVWsk& sk, const PVWParam& param){
+    FlatPVWsk flat;
+    flat.n = param.n;
+    flat.ell = param.ell;
+    flat.s.resize(size_t(param.n) * param.ell);
+    for(int j = 0; j < param.ell; j++){
+        for(int i = 0; i < param.n; i++){
+            flat.s[size_t(j) * param.n + i] = uint32_t(sk[j][i].ConvertToInt());
+        }
     }
-    return ret;
+    return flat;
 }
 
-void PVWEncSK(PVWCiphertext& ct, const vector<int>& msg, const PVWsk& sk, const PVWParam& param, const bool& pk_gen){
-    NativeInteger q = param.q;
-    int n = param.n;
-    int ell = param.ell;
-    DiscreteUniformGeneratorImpl<NativeVector> dug;
-    dug.SetModulus(q);
-    ct.a = dug.GenerateVector(n);
-    ct.b = dug.GenerateVector(ell);
-    NativeInteger mu = q.ComputeMu();
-    for(int j = 0; j < ell; j++){
-        ct.b[j] -= ct.b[j];
-        for (int i = 0; i < n; ++i) {
-            ct.b[j] += ct.a[i].ModMulFast(sk[j][i], q, mu);
+PVWsk fromFlatPVWsk(const FlatPVWsk& flat, const PVWParam& param){
+    PVWsk sk(param.ell);
+    for(int j = 0; j < param.ell; j++){
+        sk[j] = NativeVector(param.n, param.q);
+        for(int i = 0; i < param.n; i++){
+            sk[j][i] = flat.s[size_t(j) * param.n + i];
         }
-        ct.b[j].ModEq(q);
+    }
+    return sk;
+}
 
-        if(!pk_gen)
-            msg[j]? ct.b[j].ModAddFastEq(3*q/4, q) : ct.b[j].ModAddFastEq(q/4, q);
-        DiscreteGaussianGeneratorImpl<NativeVector> m_dgg(param.std_dev);
-        ct.b[j].ModAddFastEq(m_dgg.GenerateInteger(q), q);
+FlatPVWCiphertext toFlatPVWCiphertext(const PVWCiphertext& ct, const PVWParam& param){
+    FlatPVWCiphertext flat;
+    flat.a.resize(param.n);
+    flat.b.resize(param.ell);
+    for(int i = 0; i < param.n; i++){
+        flat.a[i] = uint32_t(ct.a[i].ConvertToInt());
     }
+    for(int j = 0; j < param.ell; j++){
+        flat.b[j] = uint32_t(ct.b[j].ConvertToInt());
+    }
+    return flat;
 }
 
-PVWpk PVWGeneratePublicKey(const PVWParam& param, const PVWsk& sk){
-    PVWpk pk(param.m);
-    vector<int> zeros(param.ell, 0);
-    for(int i = 0; i < param.m; i++){
-        PVWEncSK(pk[i], zeros, sk, param, true);
+void fromFlatPVWCiphertext(PVWCiphertext& ct, const uint32_t* a, const uint32_t* b, const PVWParam& param){
+    ct.a = NativeVector(param.n);
+    ct.b = NativeVector(param.ell);
+    for(int i = 0; i < param.n; i++){
+        ct.a[i] = a[i];
+    }
+    for(int j = 0; j < param.ell; j++){
+        ct.b[j] = b[j];
+    }
+}
+
+PVWCiphertext fromFlatPVWCiphertext(const FlatPVWCiphertext& flat, const PVWParam& param){
+    PVWCiphertext ct;
+    fromFlatPVWCiphertext(ct, flat.a.data(), flat.b.data(), param);
+    return ct;
+}
+
+FlatPVWpk toFlatPVWpk(const PVWpk& pk, const PVWParam& param){
+    FlatPVWpk flat;
+    flat.m = pk.size();
+    flat.width = param.n + param.ell;
+    flat.rows.resize(flat.m * flat.width);
+    for(size_t i = 0; i < flat.m; i++){
+        uint32_t* row = &flat.rows[i * flat.width];
+        for(int j = 0; j < param.n; j++){
+            row[j] = uint32_t(pk[i].a[j].ConvertToInt());
+        }
+        for(int j = 0; j < param.ell; j++){
+            row[param.n + j] = uint32_t(pk[i].b[j].ConvertToInt());
+        }
+    }
+    return flat;
+}
+
+PVWpk fromFlatPVWpk(const FlatPVWpk& flat, const PVWParam& param){
+    PVWpk pk(flat.m);
+    for(size_t i = 0; i < flat.m; i++){
+        const uint32_t* row = &flat.rows[i * flat.width];
+        fromFlatPVWCiphertext(pk[i], row, row + param.n, param);
     }
     return pk;
 }
 
+// compact file of a NativeVector key, see saveFlatPVWpk and FlatPVWpkMap
+streamoff savePVWpk(const PVWpk& pk, const PVWParam& param, ostream& stream){
+    return saveFlatPVWpk(toFlatPVWpk(pk, param), param, stream);
+}
+
+// key generation, secret-key encryption and decryption run on the flat arrays
+// the PVWsk overloads convert the whole key on every call, callers that use a key many times convert it once with toFlatPVWsk
+
+PVWsk PVWGenerateSecretKey(const PVWParam& param){
+    return fromFlatPVWsk(FlatPVWGenerateSecretKey(param), param);
+}
+
+void PVWEncSK(PVWCiphertext& ct, const vector<int>& msg, const FlatPVWsk& sk, const PVWParam& param, const bool& pk_gen){
+    FlatPVWCiphertext flat;
+    FlatPVWEncSK(flat, msg, sk, param, pk_gen);
+    ct = fromFlatPVWCiphertext(flat, param);
+}
+
+void PVWEncSK(PVWCiphertext& ct, const vector<int>& msg, const PVWsk& sk, const PVWParam& param, const bool& pk_gen){
+    PVWEncSK(ct, msg, toFlatPVWsk(sk, param), param, pk_gen);
+}
+
+PVWpk PVWGeneratePublicKey(const PVWParam& param, const PVWsk& sk){
+    return fromFlatPVWpk(FlatPVWGeneratePublicKey(param, toFlatPVWsk(sk, param)), param);
+}
+
 void PVWEncPK(PVWCiphertext& ct, const vector<int>& msg, const PVWpk& pk, const PVWParam& param){
     NativeInteger q = param.q;
     ct.a = NativeVector(param.n);
@@ -203,20 +254,79 @@ void PVWEncPK(PVWCiphertext& ct, const vector<int>& msg, const PVWpk& pk, const
     }
 }
 
+void PVWDec(vector<int>& msg, const PVWCiphertext& ct, const FlatPVWsk& sk, const PVWParam& param){
+    FlatPVWDec(msg, toFlatPVWCiphertext(ct, param), sk, param);
+}
+
 void PVWDec(vector<int>& msg, const PVWCiphertext& ct, const PVWsk& sk, const PVWParam& param){
-    msg.resize(param.ell);
-    NativeInteger q = param.q;
-    int n = param.n;
+    PVWDec(msg, ct, toFlatPVWsk(sk, param), param);
+}
 
-    for(int j = 0; j < param.ell; j++){
-        NativeInteger inner(0);
-        NativeInteger r = ct.b[j];
-        NativeInteger mu = q.ComputeMu();
-        for (int i = 0; i < n; ++i) {
-            inner += ct.a[i].ModMulFast(sk[j][i], q, mu);
+///////////////////////////////////////////////////////////
+/////////////////////////////////////////// Batched PVW public-key encryption
+///////////////////////////////////////////////////////////
+
+// See FlatPVWBatchEncryptor, the ciphertexts are converted to NativeVector
+class PVWBatchEncryptor{
+public:
+    PVWBatchEncryptor(const PVWpk& pk, const PVWParam& param)
+    : param(param), flat(toFlatPVWpk(pk, param), param)
+    {}
+
+    PVWBatchEncryptor(FlatPVWpk pk, const PVWParam& param)
+    : param(param), flat(move(pk), param)
+    {}
+
+    PVWBatchEncryptor(const FlatPVWpkMap& map, const PVWParam& param)
+    : param(param), flat(map, param)
+    {}
+
+    void encrypt(vector<PVWCiphertext>& cts, const vector<vector<int>>& msgs){
+        vector<FlatPVWCiphertext> flatCts;
+        flat.encrypt(flatCts, msgs);
+        cts.resize(flatCts.size());
+        for(size_t c = 0; c < flatCts.size(); c++){
+            cts[c] = fromFlatPVWCiphertext(flatCts[c], param);
         }
-        r.ModSubFastEq(inner, q);
-        r.ModEq(q);
-        msg[j] = (r < q/2)? 0 : 1;
     }
-}
\ No newline at end of file
+
+    void encrypt(PVWCiphertext& ct, const vector<int>& msg){
+        vector<PVWCiphertext> cts;
+        encrypt(cts, vector<vector<int>>(1, msg));
+        ct = cts[0];
+    }
+
+private:
+    PVWParam param;
+    FlatPVWBatchEncryptor flat;
+};
+
+// See FlatPVWCluePool, the clues are converted to NativeVector
+class PVWCluePool{
+public:
+    PVWCluePool(const PVWpk& pk, const PVWParam& param, const size_t capacity = 1024)
+    : param(param), flat(toFlatPVWpk(pk, param), param, capacity)
+    {}
+
+    PVWCluePool(FlatPVWpk pk, const PVWParam& param, const size_t capacity = 1024)
+    : param(param), flat(move(pk), param, capacity)
+    {}
+
+    PVWCluePool(const FlatPVWpkMap& map, const PVWParam& param, const size_t capacity = 1024)
+    : param(param), flat(map, param, capacity)
+    {}
+
+    void pop(PVWCiphertext& ct, const vector<int>& msg){
+        FlatPVWCiphertext flatCt;
+        flat.pop(flatCt, msg);
+        ct = fromFlatPVWCiphertext(flatCt, param);
+    }
+
+    size_t size(){
+        return flat.size();
+    }
+
+private:
+    PVWParam param;
+    FlatPVWCluePool flat;
+};
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <algorithm>
+#include "BucketAssignment.h"
+#include "seal/util/uintarithsmallmod.h"
 
 /**
  * 确定性索引检索 - Deterministic index retrieval
@@ -11,28 +13,29 @@
  * @param degree 多项式度数 - Polynomial degree
  * @param start 起始位置 - Start position
  * @param isMulti 是否多重 - Whether multi
+ * @param indexBase 索引相对于它编码 - Indices are encoded relative to it
  */
 void deterministicIndexRetrieval(Ciphertext& indexIndicator, const vector<Ciphertext>& SIC, const SEALContext& context,
                                     const size_t& degree, const size_t& start
-                                    , bool isMulti = false){
+                                    , bool isMulti = false, const size_t& indexBase = 0){
     BatchEncoder batch_encoder(context);                // 批编码器 - Batch encoder
     Evaluator evaluator(context);                       // 求值器 - Evaluator
     vector<uint64_t> pod_matrix(degree, 0ULL);          // POD矩阵 - POD matrix
     // 检查边界条件 - Check boundary conditions
-    if(start + SIC.size() > 16*degree){
+    if(start < indexBase || start - indexBase + SIC.size() > 16*degree){
         cerr << "counter + SIC.size should be less, please check " << start << " " << SIC.size() << endl;
         return;
     }
 
     // 遍历所有SIC - Iterate through all SIC
     for(size_t i = 0; i < SIC.size(); i++){
-        size_t idx = (i+start)/16;                      // 计算索引 - Calculate index
-        size_t shift = (i+start) % 16;                  // 计算位移 - Calculate shift
+        size_t idx = (i+start-indexBase)/16;            // 计算索引 - Calculate index
+        size_t shift = (i+start-indexBase) % 16;        // 计算位移 - Calculate shift
         pod_matrix[idx] = (1<<shift);                   // 设置位 - Set bit
         Plaintext plain_matrix;                         // 明文矩阵 - Plaintext matrix
         batch_encoder.encode(pod_matrix, plain_matrix); // 编码矩阵 - Encode matrix
         evaluator.transform_to_ntt_inplace(plain_matrix, SIC[i].parms_id()); // 转换为NTT形式 - Transform to NTT form
-        if(i == 0 && (start%degree) == 0){             // 第一个元素 - First element
+        if(i == 0 && ((start-indexBase)%degree) == 0){ // 第一个元素 - First element
             evaluator.multiply_plain(SIC[i], plain_matrix, indexIndicator);
         }
         else{                                           // 其他元素 - Other elements
@@ -44,6 +47,59 @@ void deterministicIndexRetrieval(Ciphertext& indexIndicator, const vector<Cipher
     }
 }
 
+/**
+ * 索引块 - Index blocks
+ * 确定性索引每个槽位16条消息，即每个索引密文16*degree条消息（t = 65537时每个槽位只有16位）
+ * Deterministic indices take 16 messages per slot, i.e. 16*degree messages per index ciphertext (a slot only has 16 bits with t = 65537)
+ * 更大的公告板溢出到更多的索引密文：第k块保存[k*16*degree, (k+1)*16*degree)内的消息
+ * Larger boards spill into more index ciphertexts: block k holds the messages in [k*16*degree, (k+1)*16*degree)
+ * 每多一块，摘要多一个最后一级的密文（N = 32768时约280KB，即2^22条消息时8块）
+ * Every block adds one last-level ciphertext to the digest (~280KB for N = 32768, i.e. 8 blocks for 2^22 messages)
+ * 尚未写入的块为空密文（size() == 0），代表零 - Blocks not written yet are empty ciphertexts (size() == 0) and stand for zero
+ */
+
+// 覆盖numOfTransactions条消息所需的索引块数 - Number of index blocks covering numOfTransactions messages
+size_t indexBlocks(const size_t numOfTransactions, const size_t degree){
+    return (numOfTransactions + 16*degree - 1) / (16*degree);
+}
+
+/**
+ * 多块确定性索引检索 - Deterministic index retrieval over index blocks
+ * SIC不能跨越块边界；32条一批时总是如此，因为16*degree是32的倍数
+ * The SICs must not straddle a block boundary, which always holds for batches of 32 as 16*degree is a multiple of 32
+ * @param indexIndicators 索引块 - Index blocks
+ * @param SIC SIC密文向量 - SIC ciphertext vector
+ * @param context SEAL上下文 - SEAL context
+ * @param degree 多项式度数 - Polynomial degree
+ * @param start 起始位置 - Start position
+ * @param indexBase 索引相对于它编码 - Indices are encoded relative to it
+ */
+void deterministicIndexRetrieval(vector<Ciphertext>& indexIndicators, const vector<Ciphertext>& SIC, const SEALContext& context,
+                                    const size_t& degree, const size_t& start, const size_t& indexBase = 0){
+    size_t block = (start - indexBase) / (16*degree);
+    if(SIC.empty() || (start - indexBase + SIC.size() - 1) / (16*degree) != block){
+        cerr << "The SICs should fall into one index block, please check " << start << " " << SIC.size() << endl;
+        return;
+    }
+    if(indexIndicators.size() <= block)
+        indexIndicators.resize(block + 1);
+    deterministicIndexRetrieval(indexIndicators[block], SIC, context, degree, start, false, indexBase + block*16*degree);
+}
+
+// 按块相加索引摘要，空块代表零 - Add index digests block-wise, empty blocks stand for zero
+void addIndexBlocks(vector<Ciphertext>& sum, const vector<Ciphertext>& blocks, const Evaluator& evaluator){
+    if(sum.size() < blocks.size())
+        sum.resize(blocks.size());
+    for(size_t k = 0; k < blocks.size(); k++){
+        if(blocks[k].size() == 0)
+            continue;
+        if(sum[k].size() == 0)
+            sum[k] = blocks[k];
+        else
+            evaluator.add_inplace(sum[k], blocks[k]);
+    }
+}
+
 /**
  * 随机化索引检索 - For randomized index retrieval
  * 我们首先有2个密文，因为我们需要表示N ~= 500,000，所以sqrt(N) < 65537
@@ -130,26 +186,27 @@ void randomizedIndexRetrieval(vector<vector<Ciphertext>>& indexIndicator, vector
 
 // generate the random assignment of each message represented as a bipartite grap
 // generate weights for each assignment
-void bipartiteGraphWeightsGeneration(vector<vector<int>>& bipartite_map, vector<vector<int>>& weights, const int& num_of_transactions, const int& num_of_buckets, const int& repetition, const int& seed){
-    srand(seed);
-    bipartite_map.clear();
-    weights.clear();
+// every row is derived from (seed, index) by bucketsOf, so rows [0, first) are kept as they are and only the rest is generated
+void bipartiteGraphWeightsGeneration(vector<vector<int>>& bipartite_map, vector<vector<int>>& weights, const int& num_of_transactions, const int& num_of_buckets, const int& repetition, const int& seed,
+                                    const int& first = 0){
     bipartite_map.resize(num_of_transactions);
     weights.resize(num_of_transactions);
-    for(int i = 0; i < num_of_transactions; i++)
+    for(int i = max(first, 0); i < num_of_transactions; i++)
     {
-        bipartite_map[i].resize(repetition, -1);
-        weights[i].resize(repetition, -1);
-        for(int j = 0; j < repetition; j++){
-            int temp = rand()%num_of_buckets;
-            // avoid repeatition
-            while(find(bipartite_map[i].begin(), bipartite_map[i].end(), temp) != bipartite_map[i].end()){
-                temp = rand()%num_of_buckets;
-            }
-            bipartite_map[i][j] = temp;
-            // weight is non-zero
-            weights[i][j] = rand()%65536 + 1;
-        }
+        bucketsOf(bipartite_map[i], weights[i], uint64_t(i), num_of_buckets, repetition, seed);
+    }
+}
+
+// rows of the messages [start, end) only, row r describes message start + r
+// bit-identical to the same rows of the full map however the board is partitioned, so every worker derives the rows of its own batch
+// and the kernels below take the window with mapBase = start
+void bipartiteGraphWeightsWindow(vector<vector<int>>& bipartite_map, vector<vector<int>>& weights, const size_t& start, const size_t& end,
+                                const int& num_of_buckets, const int& repetition, const int& seed){
+    bipartite_map.resize(end - start);
+    weights.resize(end - start);
+    for(size_t i = start; i < end; i++)
+    {
+        bucketsOf(bipartite_map[i-start], weights[i-start], uint64_t(i), num_of_buckets, repetition, seed);
     }
 }
 
@@ -192,6 +249,134 @@ void payloadRetrievalOptimizedwithWeights(vector<vector<Ciphertext>>& results, c
     }
 }
 
+// Write the weighted payload of one message into its buckets of padded, and encode it into plain_matrix in NTT form at parms_id
+// Only repetition*payloadSize (5*306 = 1530) of the degree slots are touched, padded is left all zero on return
+// plain_matrix may be left in NTT form by a previous call, its buffer is reused
+inline
+void encodeWeightedPayloadNTT(Plaintext& plain_matrix, vector<uint64_t>& padded, const vector<uint64_t>& payload, const vector<int>& buckets, const vector<int>& weights,
+                        const BatchEncoder& batch_encoder, const Evaluator& evaluator, const parms_id_type& parms_id, const int payloadSize = 306){
+    for(size_t j = 0; j < buckets.size(); j++){
+        auto paddedStart = size_t(buckets[j])*payloadSize;
+        uint64_t weight = uint64_t(weights[j]);
+        for(size_t k = 0; k < payload.size(); k++){
+            padded[k+paddedStart] = (payload[k]*weight) % 65537; // buckets of one message never overlap
+        }
+    }
+
+    plain_matrix.parms_id() = parms_id_zero; // so that encode can reuse the buffer of an NTT-form plaintext
+    batch_encoder.encode(padded, plain_matrix);
+    evaluator.transform_to_ntt_inplace(plain_matrix, parms_id);
+
+    for(size_t j = 0; j < buckets.size(); j++){
+        auto paddedStart = padded.begin() + size_t(buckets[j])*payloadSize;
+        fill(paddedStart, paddedStart + payload.size(), 0ULL);
+    }
+}
+
+// Sparse kernel for the function above, same inputs and outputs
+// Only repetition*payloadSize (5*306 = 1530) of the degree slots are non-zero for each message
+// So we keep one slot buffer and one plaintext for the whole call,
+// write only the bucket slots of each message, and clear only those slots afterwards,
+// instead of allocating and zeroing a fresh degree-sized vector and plaintext per message
+// Note that the encode and the NTT are still paid once per message:
+// expressing the plaintext in precomputed per-bucket NTT bases needs payloadSize dense
+// axpys per bucket, which is more work than one encode + NTT
+// bipartite_map and weights may be a window whose first row describes message mapBase
+void payloadRetrievalSparseWithWeights(vector<vector<Ciphertext>>& results, const vector<vector<uint64_t>>& payloads, const vector<vector<int>>& bipartite_map, const vector<vector<int>>& weights,
+                        const vector<Ciphertext>& SIC, const SEALContext& context, const size_t& degree = 32768, const size_t& start = 0, const size_t& local_start = 0, const int payloadSize = 306,
+                        const size_t& mapBase = 0){
+    Evaluator evaluator(context);
+    BatchEncoder batch_encoder(context);
+    results.resize(SIC.size());
+
+    vector<uint64_t> padded(degree, 0);
+    Plaintext plain_matrix;
+    for(size_t i = 0; i < SIC.size(); i++){
+        results[i].resize(1);
+        encodeWeightedPayloadNTT(plain_matrix, padded, payloads[i+local_start], bipartite_map[i+start-mapBase], weights[i+start-mapBase],
+                                batch_encoder, evaluator, SIC[i].parms_id(), payloadSize);
+        evaluator.multiply_plain(SIC[i], plain_matrix, results[i][0]);
+    }
+}
+
+// Fused phase 2 kernel of OMR2: deterministicIndexRetrieval + payloadRetrievalSparseWithWeights + payloadPackingOptimized
+// Each NTT-form SIC is streamed once, and every coefficient is multiply-accumulated into both
+// the index digest (lhs) and the payload digest (rhs) in the same pass
+// No per-message ciphertext temporaries and no payloadUnpacked are materialized,
+// and the index and payload plaintexts are reused across messages
+// lhs and rhs are initialized by the first message of a batch (start%degree == 0), same as the unfused steps
+// Indices are encoded relative to indexBase, so a range [indexBase, indexBase + 16*degree) of any board fits;
+// the payload buckets still use absolute indices, the bipartite map may be a window whose first row describes message mapBase
+void fusedIndexPayloadRetrieval(Ciphertext& lhs, Ciphertext& rhs, const vector<Ciphertext>& SIC, const vector<vector<uint64_t>>& payloads,
+                        const vector<vector<int>>& bipartite_map, const vector<vector<int>>& weights, const SEALContext& context,
+                        const size_t& degree, const size_t& start, const size_t& local_start = 0, const int payloadSize = 306,
+                        const size_t& indexBase = 0, const size_t& mapBase = 0){
+    Evaluator evaluator(context);
+    BatchEncoder batch_encoder(context);
+    if(start < indexBase || start - indexBase + SIC.size() > 16*degree){
+        cerr << "counter + SIC.size should be less, please check " << start << " " << SIC.size() << endl;
+        return;
+    }
+
+    vector<uint64_t> pod_matrix(degree, 0ULL);
+    vector<uint64_t> padded(degree, 0ULL);
+    Plaintext plain_index, plain_payload;
+    for(size_t i = 0; i < SIC.size(); i++){
+        size_t idx = (i+start-indexBase)/16;
+        size_t shift = (i+start-indexBase) % 16;
+        pod_matrix[idx] = (1<<shift);
+        plain_index.parms_id() = parms_id_zero;
+        batch_encoder.encode(pod_matrix, plain_index);
+        evaluator.transform_to_ntt_inplace(plain_index, SIC[i].parms_id());
+        pod_matrix[idx] = 0ULL;
+
+        encodeWeightedPayloadNTT(plain_payload, padded, payloads[i+local_start], bipartite_map[i+start-mapBase], weights[i+start-mapBase],
+                                batch_encoder, evaluator, SIC[i].parms_id(), payloadSize);
+
+        if(i == 0 && ((start-indexBase)%degree) == 0){
+            evaluator.multiply_plain(SIC[i], plain_index, lhs);
+            evaluator.multiply_plain(SIC[i], plain_payload, rhs);
+            continue;
+        }
+        if(!SIC[i].is_ntt_form() || lhs.parms_id() != SIC[i].parms_id() || rhs.parms_id() != SIC[i].parms_id()){
+            cerr << "SIC and digests should be in NTT form at the same level." << endl;
+            return;
+        }
+
+        auto& coeff_modulus = context.get_context_data(SIC[i].parms_id())->parms().coeff_modulus();
+        for(size_t p = 0; p < SIC[i].size(); p++){
+            const uint64_t* sic_poly = SIC[i].data(p);
+            uint64_t* lhs_poly = lhs.data(p);
+            uint64_t* rhs_poly = rhs.data(p);
+            for(size_t r = 0; r < coeff_modulus.size(); r++){
+                const Modulus& q = coeff_modulus[r];
+                size_t offset = r*degree;
+                for(size_t c = offset; c < offset + degree; c++){
+                    lhs_poly[c] = util::add_uint_mod(lhs_poly[c], util::multiply_uint_mod(sic_poly[c], plain_index[c], q), q);
+                    rhs_poly[c] = util::add_uint_mod(rhs_poly[c], util::multiply_uint_mod(sic_poly[c], plain_payload[c], q), q);
+                }
+            }
+        }
+    }
+}
+
+// Fused phase 2 kernel over index blocks, the SICs must fall into one block (see deterministicIndexRetrieval)
+// The block is initialized together with rhs by the first message of a batch
+void fusedIndexPayloadRetrieval(vector<Ciphertext>& lhs, Ciphertext& rhs, const vector<Ciphertext>& SIC, const vector<vector<uint64_t>>& payloads,
+                        const vector<vector<int>>& bipartite_map, const vector<vector<int>>& weights, const SEALContext& context,
+                        const size_t& degree, const size_t& start, const size_t& local_start = 0, const int payloadSize = 306,
+                        const size_t& indexBase = 0, const size_t& mapBase = 0){
+    size_t block = (start - indexBase) / (16*degree);
+    if(SIC.empty() || (start - indexBase + SIC.size() - 1) / (16*degree) != block){
+        cerr << "The SICs should fall into one index block, please check " << start << " " << SIC.size() << endl;
+        return;
+    }
+    if(lhs.size() <= block)
+        lhs.resize(block + 1);
+    fusedIndexPayloadRetrieval(lhs[block], rhs, SIC, payloads, bipartite_map, weights, context, degree, start, local_start, payloadSize,
+                                indexBase + block*16*degree, mapBase);
+}
+
 // use only addition to pack
 void payloadPackingOptimized(Ciphertext& result, const vector<vector<Ciphertext>>& payloads, const vector<vector<int>>& bipartite_map, const size_t& degree, 
                         const SEALContext& context, const GaloisKeys& gal_keys, const size_t& start = 0, const int payloadSize = 306){
@@ -4,6 +4,15 @@
 #include "include/retrieval.h"        // 检索相关函数 - Retrieval related functions
 #include "include/client.h"           // 客户端相关函数 - Client related functions
 #include "include/LoadAndSaveUtils.h" // 数据加载和保存工具 - Data loading and saving utilities
+#include "include/ParamProfiles.h"    // BFV参数配置 - BFV parameter profiles
+#include "include/CompactDigest.h"    // 紧凑摘要格式 - Compact digest format
+#include "include/LevelPlanner.h"     // 模数级别计划报告 - Modulus level plan report
+#include "include/DigestAccumulator.h" // 增量摘要累加器 - Incremental digest accumulator
+#include "include/EpochDigestStore.h" // 按时段的部分摘要存储 - Per-epoch partial digest store
+#include "include/DetectionDaemon.h" // 持续摄取的检测守护进程 - Continuous ingestion detection daemon
+#include "include/RecipientDecoding.h" // 轻量的接收者解码 - Lightweight recipient decoding
+#include "include/BatchRecipientDecoder.h" // 批量接收者解码 - Batch recipient decoding
+#include "include/DetectionKeyGen.h" // 并行的检测密钥生成 - Parallel detection key generation
 #include <NTL/BasicThreadPool.h>      // NTL线程池 - NTL thread pool
 #include <NTL/ZZ.h>                   // NTL大整数类型 - NTL big integer type
 #include <thread>                     // C++线程库 - C++ thread library
@@ -39,19 +48,26 @@ vector<vector<uint64_t>> preparinngTransactionsFormal(PVWpk& pk,
 
     cout << "Expected Message Indices: ";   // 输出预期的消息索引 - Output expected message indices
 
+    // 一次批量加密所有相关消息的线索 - Encrypt the clues of all pertinent messages in one batch
+    PVWBatchEncryptor encryptor(pk, params);
+    vector<PVWCiphertext> pertinentClues;
+    encryptor.encrypt(pertinentClues, vector<vector<int>>(pertinentMsgNum, zeros));
+
     // 为每个交易生成线索 - Generate clues for each transaction
-    for(int i = 0; i < numOfTransactions; i++){
+    FlatPVWCiphertext flatclue;              // 无关线索在平坦数组上生成 - Non-pertinent clues are generated on flat arrays
+    for(int i = 0, p = 0; i < numOfTransactions; i++){
         PVWCiphertext tempclue;              // 临时线索密文 - Temporary clue ciphertext
         if(msgs[i]){                         // 如果是相关消息 - If it's a pertinent message
             cout << i << " ";
-            PVWEncPK(tempclue, zeros, pk, params);        // 使用公钥加密 - Encrypt with public key
+            tempclue = pertinentClues[p++];               // 使用公钥加密 - Encrypted with public key
             ret.push_back(loadDataSingle(i));             // 加载单个数据 - Load single data
             expectedIndices.push_back(uint64_t(i));       // 添加到预期索引 - Add to expected indices
         }
         else
         {
-            auto sk2 = PVWGenerateSecretKey(params);       // 生成新的密钥 - Generate new secret key
-            PVWEncSK(tempclue, zeros, sk2, params);       // 使用密钥加密 - Encrypt with secret key
+            auto sk2 = FlatPVWGenerateSecretKey(params);   // 生成新的密钥 - Generate new secret key
+            FlatPVWEncSK(flatclue, zeros, sk2, params);   // 使用密钥加密 - Encrypt with secret key
+            tempclue = fromFlatPVWCiphertext(flatclue, params);
         }
 
         saveClues(tempclue, i);              // 保存线索 - Save clues
@@ -63,22 +79,21 @@ vector<vector<uint64_t>> preparinngTransactionsFormal(PVWpk& pk,
 /**
  * 阶段1：获取打包的SIC - Phase 1: obtaining packed SIC
  * @param SICPVW PVW密文向量 - PVW ciphertext vector
- * @param switchingKey 切换密钥 - Switching key
+ * @param switchingKeyCache 旋转切换密钥缓存 - Rotated switching key cache
  * @param relin_keys 重线性化密钥 - Relinearization keys
- * @param gal_keys 伽罗瓦密钥 - Galois keys
  * @param degree 多项式度数 - Polynomial degree
  * @param context SEAL上下文 - SEAL context
  * @param params PVW参数 - PVW parameters
  * @param numOfTransactions 交易数量 - Number of transactions
  * @return 返回打包的密文 - Returns packed ciphertext
  */
-Ciphertext serverOperations1obtainPackedSIC(vector<PVWCiphertext>& SICPVW, vector<Ciphertext> switchingKey, const RelinKeys& relin_keys,
-                            const GaloisKeys& gal_keys, const size_t& degree, const SEALContext& context, const PVWParam& params, const int numOfTransactions){
+Ciphertext serverOperations1obtainPackedSIC(vector<PVWCiphertext>& SICPVW, const RotatedSwitchingKeyCache& switchingKeyCache, const RelinKeys& relin_keys,
+                            const size_t& degree, const SEALContext& context, const PVWParam& params, const int numOfTransactions){
     Evaluator evaluator(context);                    // 创建求值器 - Create evaluator
 
     vector<Ciphertext> packedSIC(params.ell);        // 打包的SIC向量 - Packed SIC vector
-    // 计算B+AS的PVW优化版本 - Compute optimized PVW version of B+AS
-    computeBplusASPVWOptimized(packedSIC, SICPVW, switchingKey, gal_keys, context, params);
+    // 计算B+AS的PVW优化版本，旋转的切换密钥来自缓存 - Compute optimized PVW version of B+AS, rotated switching keys come from the cache
+    computeBplusASPVWOptimized(packedSIC, SICPVW, switchingKeyCache, context, params);
 
     int rangeToCheck = 850;                          // 范围检查从[-rangeToCheck, rangeToCheck-1] - Range check from [-rangeToCheck, rangeToCheck-1]
     // 执行新的PVW范围检查 - Perform new PVW range check
@@ -87,10 +102,58 @@ Ciphertext serverOperations1obtainPackedSIC(vector<PVWCiphertext>& SICPVW, vecto
     return packedSIC[0];                             // 返回第一个打包的SIC - Return first packed SIC
 }
 
+/**
+ * 阶段1：获取打包的SIC，不使用缓存 - Phase 1: obtaining packed SIC without a cache
+ * @param SICPVW PVW密文向量 - PVW ciphertext vector
+ * @param switchingKey 切换密钥 - Switching key
+ * @param relin_keys 重线性化密钥 - Relinearization keys
+ * @param gal_keys 伽罗瓦密钥 - Galois keys
+ * @param degree 多项式度数 - Polynomial degree
+ * @param context SEAL上下文 - SEAL context
+ * @param params PVW参数 - PVW parameters
+ * @param numOfTransactions 交易数量 - Number of transactions
+ * @return 返回打包的密文 - Returns packed ciphertext
+ */
+Ciphertext serverOperations1obtainPackedSIC(vector<PVWCiphertext>& SICPVW, const vector<Ciphertext>& switchingKey, const RelinKeys& relin_keys,
+                            const GaloisKeys& gal_keys, const size_t& degree, const SEALContext& context, const PVWParam& params, const int numOfTransactions){
+    RotatedSwitchingKeyCache switchingKeyCache(switchingKey, gal_keys, context, params); // 不复制任何密文 - Copies no ciphertext
+    return serverOperations1obtainPackedSIC(SICPVW, switchingKeyCache, relin_keys, degree, context, params, numOfTransactions);
+}
+
+/**
+ * 阶段1（打包分量布局）：获取打包的SIC - Phase 1 (packed-components layout): obtaining packed SIC
+ * 所有ell个分量位于同一密文的不同槽位块中，只需一次范围检查
+ * All ell components sit in different slot blocks of one ciphertext, so only one range check is needed
+ * 适用于不超过degree/ell - tempn + 1条线索的批次 - Applies to batches of at most degree/ell - tempn + 1 clues
+ * @param SICPVW PVW密文向量 - PVW ciphertext vector
+ * @param switchingKey 打包分量切换密钥 - Packed-components switching key
+ * @param relin_keys 重线性化密钥 - Relinearization keys
+ * @param gal_keys 伽罗瓦密钥 - Galois keys
+ * @param gal_keys_packed 范围检查输出级别的旋转密钥 - Rotation keys at the range check output level
+ * @param degree 多项式度数 - Polynomial degree
+ * @param context SEAL上下文 - SEAL context
+ * @param context_packed 范围检查输出级别的子上下文 - Sub-context at the range check output level
+ * @param params PVW参数 - PVW parameters
+ * @return 返回打包的密文 - Returns packed ciphertext
+ */
+Ciphertext serverOperations1obtainPackedSICPackedComponents(vector<PVWCiphertext>& SICPVW, const Ciphertext& switchingKey, const RelinKeys& relin_keys,
+                            const GaloisKeys& gal_keys, const GaloisKeys& gal_keys_packed, const size_t& degree, const SEALContext& context,
+                            const SEALContext& context_packed, const PVWParam& params){
+    Ciphertext packedSIC;                            // 打包的SIC - Packed SIC
+    // 计算B+AS，所有分量在一个密文中 - Compute B+AS with all components in one ciphertext
+    computeBplusASPVWPackedComponents(packedSIC, SICPVW, switchingKey, gal_keys, context, params);
+
+    int rangeToCheck = 850;                          // 范围检查从[-rangeToCheck, rangeToCheck-1] - Range check from [-rangeToCheck, rangeToCheck-1]
+    // 一次范围检查，然后合并各分量块 - One range check, then combine the component blocks
+    newRangeCheckPVWPackedComponents(packedSIC, rangeToCheck, relin_keys, gal_keys_packed, degree, context, context_packed, params);
+
+    return packedSIC;
+}
+
 /**
  * 阶段2：检索操作的其余部分 - Phase 2: the rest of retrieval operations
- * @param lhs 左侧密文 - Left-hand side ciphertext
- * @param bipartite_map 二分图映射 - Bipartite map
+ * @param lhs 左侧索引块 - Left-hand side index blocks
+ * @param bipartite_map 本批次的二分图窗口（输出） - Bipartite window of this batch (output)
  * @param rhs 右侧密文 - Right-hand side ciphertext
  * @param packedSIC 打包的SIC - Packed SIC
  * @param payload 载荷数据 - Payload data
@@ -104,7 +167,7 @@ Ciphertext serverOperations1obtainPackedSIC(vector<PVWCiphertext>& SICPVW, vecto
  * @param counter 计数器 - Counter
  * @param payloadSize 载荷大小 - Payload size
  */
-void serverOperations2therest(Ciphertext& lhs, vector<vector<int>>& bipartite_map, Ciphertext& rhs,
+void serverOperations2therest(vector<Ciphertext>& lhs, vector<vector<int>>& bipartite_map, Ciphertext& rhs,
                         Ciphertext& packedSIC, const vector<vector<uint64_t>>& payload, const RelinKeys& relin_keys, const GaloisKeys& gal_keys,
                         const size_t& degree, const SEALContext& context, const SEALContext& context2, const PVWParam& params, const int numOfTransactions,
                         int& counter, const int payloadSize = 306){
@@ -112,30 +175,30 @@ void serverOperations2therest(Ciphertext& lhs, vector<vector<int>>& bipartite_ma
     Evaluator evaluator(context);                    // 创建求值器 - Create evaluator
     int step = 32;                                   // 为节省内存，每次处理32条消息 - Process 32 messages at a time to save memory
 
+    // 只导出本批次的桶和权重，与划分方式无关 - Derive the buckets and weights of this batch only, independent of the partitioning
+    vector<vector<int>> weights;                     // 权重 - Weights
+    bipartiteGraphWeightsWindow(bipartite_map, weights, counter, counter+numOfTransactions, OMRtwoM, repeatition_glb, seed_glb);
+
     // 分批处理交易 - Process transactions in batches
     for(int i = counter; i < counter+numOfTransactions; i += step){
         vector<Ciphertext> expandedSIC;              // 扩展的SIC - Expanded SIC
         // 步骤1：扩展PV - Step 1: expand PV
-        expandSIC(expandedSIC, packedSIC, gal_keys, int(degree), context, context2, step, i-counter);
+        expandSIC(expandedSIC, packedSIC, gal_keys, gal_keys_last, int(degree), context, context2, step, i-counter);
 
         // 转换为NTT形式以提高效率，特别是对于最后两个步骤 - Transform to NTT form for better efficiency, especially for the last two steps
         for(size_t j = 0; j < expandedSIC.size(); j++)
             if(!expandedSIC[j].is_ntt_form())
                 evaluator.transform_to_ntt_inplace(expandedSIC[j]);
 
-        // 步骤2：确定性检索 - Step 2: deterministic retrieval
-        deterministicIndexRetrieval(lhs, expandedSIC, context, degree, i);
-
-        // 步骤3-4：乘以权重并打包 - Step 3-4: multiply weights and pack them
-        // 以下两个步骤用于流式更新 - The following two steps are for streaming updates
-        vector<vector<Ciphertext>> payloadUnpacked;  // 未打包的载荷 - Unpacked payload
-        payloadRetrievalOptimizedwithWeights(payloadUnpacked, payload, bipartite_map_glb, weights_glb, expandedSIC, context, degree, i, i - counter);
+        // 步骤2-4：确定性检索，乘以权重并打包，一次遍历完成 - Step 2-4: deterministic retrieval, multiply weights and pack them, in one pass
+        // 每个SIC只读取一次，同时累加到lhs和rhs - Each SIC is read once and accumulated into both lhs and rhs
         // 注意：如果重复次数已设定，这是流式更新唯一需要的步骤 - Note: if number of repetitions is already set, this is the only step needed for streaming updates
-        payloadPackingOptimized(rhs, payloadUnpacked, bipartite_map_glb, degree, context, gal_keys, i);
+        fusedIndexPayloadRetrieval(lhs, rhs, expandedSIC, payload, bipartite_map, weights, context, degree, i, i - counter, payloadSize, 0, counter);
     }
     // 如果是NTT形式，转换回普通形式 - If in NTT form, transform back to normal form
-    if(lhs.is_ntt_form())
-        evaluator.transform_from_ntt_inplace(lhs);
+    for(size_t k = 0; k < lhs.size(); k++)
+        if(lhs[k].is_ntt_form())
+            evaluator.transform_from_ntt_inplace(lhs[k]);
     if(rhs.is_ntt_form())
         evaluator.transform_from_ntt_inplace(rhs);
 
@@ -146,7 +209,7 @@ void serverOperations2therest(Ciphertext& lhs, vector<vector<int>>& bipartite_ma
  * 阶段2：OMR3的检索操作 - Phase 2: retrieving for OMR3
  * @param lhs 左侧密文向量 - Left-hand side ciphertext vector
  * @param lhsCounter 左侧计数器 - Left-hand side counter
- * @param bipartite_map 二分图映射 - Bipartite map
+ * @param bipartite_map 本批次的二分图窗口（输出） - Bipartite window of this batch (output)
  * @param rhs 右侧密文 - Right-hand side ciphertext
  * @param packedSIC 打包的SIC - Packed SIC
  * @param payload 载荷数据 - Payload data
@@ -168,12 +231,16 @@ void serverOperations3therest(vector<vector<Ciphertext>>& lhs, vector<Ciphertext
 
     Evaluator evaluator(context);                    // 创建求值器 - Create evaluator
 
+    // 只导出本批次的桶和权重，与划分方式无关 - Derive the buckets and weights of this batch only, independent of the partitioning
+    vector<vector<int>> weights;                     // 权重 - Weights
+    bipartiteGraphWeightsWindow(bipartite_map, weights, counter, counter+numOfTransactions, OMRthreeM, repeatition_glb, seed_glb);
+
     int step = 32;                                   // 批处理大小 - Batch size
     // 分批处理交易 - Process transactions in batches
     for(int i = counter; i < counter+numOfTransactions; i += step){
         // 步骤1：扩展PV - Step 1: expand PV
         vector<Ciphertext> expandedSIC;              // 扩展的SIC - Expanded SIC
-        expandSIC(expandedSIC, packedSIC, gal_keys, int(degree), context, context2, step, i-counter);
+        expandSIC(expandedSIC, packedSIC, gal_keys, gal_keys_last, int(degree), context, context2, step, i-counter);
         // 转换为NTT形式以提高所有后续步骤的效率 - Transform to NTT form for better efficiency for all following steps
         for(size_t j = 0; j < expandedSIC.size(); j++)
             if(!expandedSIC[j].is_ntt_form())
@@ -185,9 +252,9 @@ void serverOperations3therest(vector<vector<Ciphertext>>& lhs, vector<Ciphertext
         // 步骤3-4：乘以权重并打包 - Step 3-4: multiply weights and pack them
         // 以下两个步骤用于流式更新 - The following two steps are for streaming updates
         vector<vector<Ciphertext>> payloadUnpacked;  // 未打包的载荷 - Unpacked payload
-        payloadRetrievalOptimizedwithWeights(payloadUnpacked, payload, bipartite_map_glb, weights_glb, expandedSIC, context, degree, i, i-counter);
+        payloadRetrievalSparseWithWeights(payloadUnpacked, payload, bipartite_map, weights, expandedSIC, context, degree, i, i-counter, payloadSize, counter);
         // 注意：如果重复次数已设定，这是流式更新唯一需要的步骤 - Note: if number of repetitions is already set, this is the only step needed for streaming updates
-        payloadPackingOptimized(rhs, payloadUnpacked, bipartite_map_glb, degree, context, gal_keys, i);
+        payloadPackingOptimized(rhs, payloadUnpacked, bipartite_map, degree, context, gal_keys, i);
     }
     // 将所有密文从NTT形式转换回普通形式 - Transform all ciphertexts from NTT form back to normal form
     for(size_t i = 0; i < lhs.size(); i++){
@@ -201,27 +268,71 @@ void serverOperations3therest(vector<vector<Ciphertext>>& lhs, vector<Ciphertext
     counter += numOfTransactions;                    // 更新计数器 - Update counter
 }
 
+/**
+ * 将新发布的消息追加到摘要 - Append newly posted messages to a digest
+ * 只对新范围执行阶段1和阶段2，每批最多degree条消息 - Runs phase 1 and phase 2 on the new range only, at most degree messages per batch
+ * 能放入分量打包布局的部分批次只做一次范围检查 - Partial batches that fit into the packed-components layout run a single range check
+ * @param accumulator 摘要累加器 - Digest accumulator
+ * @param numOfNew 新消息数量 - Number of new messages
+ * @param switchingKeyCache 旋转切换密钥缓存 - Rotated switching key cache
+ * @param switchingKeyPacked 分量打包布局的切换密钥 - Switching key of the packed-components layout
+ * @param relin_keys 重线性化密钥 - Relinearization keys
+ * @param gal_keys 伽罗瓦密钥 - Galois keys
+ * @param gal_keys_last 内积级别的伽罗瓦密钥 - Galois keys at the innerSum level
+ * @param gal_keys_packed 范围检查输出级别的旋转密钥 - Rotation keys at the range check output level
+ * @param public_key 公钥 - Public key
+ * @param degree 多项式度数 - Polynomial degree
+ * @param context SEAL上下文 - SEAL context
+ * @param context_next 展开级别的子上下文 - Sub-context at the expansion level
+ * @param context_last 内积级别的子上下文 - Sub-context at the innerSum level
+ * @param context_packed 范围检查输出级别的子上下文 - Sub-context at the range check output level
+ * @param params PVW参数 - PVW parameters
+ */
+void serverOperationsAppend(DigestAccumulator& accumulator, const int numOfNew, const RotatedSwitchingKeyCache& switchingKeyCache,
+                        const Ciphertext& switchingKeyPacked, const RelinKeys& relin_keys, const GaloisKeys& gal_keys,
+                        const GaloisKeys& gal_keys_last, const GaloisKeys& gal_keys_packed, const PublicKey& public_key,
+                        const size_t& degree, const SEALContext& context, const SEALContext& context_next, const SEALContext& context_last,
+                        const SEALContext& context_packed, const PVWParam& params){
+    vector<PVWCiphertext> SICPVW;
+    vector<vector<uint64_t>> payload;
+    int end = int(accumulator.numOfMessages()) + numOfNew;
+    for(int start = int(accumulator.numOfMessages()); start < end; start += int(degree)){
+        int batch = min(int(degree), end - start);
+        loadClues(SICPVW, start, start + batch, params);
+        loadData(payload, start, start + batch);
+        Ciphertext packedSIC;
+        if(canPackPVWComponents(batch, degree, params))
+            packedSIC = serverOperations1obtainPackedSICPackedComponents(SICPVW, switchingKeyPacked, relin_keys, switchingKeyCache.galoisKeys(),
+                                                                        gal_keys_packed, degree, context, context_packed, params);
+        else
+            packedSIC = serverOperations1obtainPackedSIC(SICPVW, switchingKeyCache, relin_keys, degree, context, params, batch);
+        if(!accumulator.append(packedSIC, payload, batch, gal_keys, gal_keys_last, public_key, degree, context_next, context_last))
+            return;
+    }
+}
+
 /**
  * 接收方解码函数 - Receiver decoding function
- * @param lhsEnc 加密的左侧数据 - Encrypted left-hand side data
- * @param bipartite_map 二分图映射 - Bipartite map
+ * @param lhsEnc 加密的索引块 - Encrypted index blocks
  * @param rhsEnc 加密的右侧数据 - Encrypted right-hand side data
  * @param degree 多项式度数 - Polynomial degree
  * @param secret_key 密钥 - Secret key
  * @param context SEAL上下文 - SEAL context
- * @param numOfTransactions 交易数量 - Number of transactions
- * @param seed 随机种子 - Random seed
+ * @param numOfTransactions 交易数量，范围查询时为范围长度 - Number of transactions, the range length for range queries
+ * @param seed 检测者分配桶时使用的种子 - Seed the detector assigned the buckets with
+ * @param indexBase 范围查询的起始消息 - First message of a range query
  * @param payloadUpperBound 载荷上界 - Payload upper bound
  * @param payloadSize 载荷大小 - Payload size
  * @return 返回解码后的数据 - Returns decoded data
  */
-vector<vector<long>> receiverDecoding(Ciphertext& lhsEnc, vector<vector<int>>& bipartite_map, Ciphertext& rhsEnc,
-                        const size_t& degree, const SecretKey& secret_key, const SEALContext& context, const int numOfTransactions, int seed = 3,
+vector<vector<long>> receiverDecoding(vector<Ciphertext>& lhsEnc, Ciphertext& rhsEnc,
+                        const size_t& degree, const SecretKey& secret_key, const SEALContext& context, const int numOfTransactions,
+                        const int seed, const int indexBase = 0,
                         const int payloadUpperBound = 306, const int payloadSize = 306){
 
     // 1. 查找相关索引 - Find pertinent indices
     map<int, int> pertinentIndices;              // 相关索引映射 - Pertinent indices map
-    decodeIndices(pertinentIndices, lhsEnc, numOfTransactions, degree, secret_key, context);
+    decodeIndices(pertinentIndices, lhsEnc, numOfTransactions, degree, secret_key, context, indexBase);
     // 输出找到的所有索引 - Print out all the indices found
     for (map<int, int>::iterator it = pertinentIndices.begin(); it != pertinentIndices.end(); it++)
     {
@@ -235,10 +346,10 @@ vector<vector<long>> receiverDecoding(Ciphertext& lhsEnc, vector<vector<int>>& b
 
     // 3. 构建左侧方程 - Forming left-hand side
     vector<vector<int>> lhs;                     // 左侧数据 - Left-hand side data
-    formLhsWeights(lhs, pertinentIndices, bipartite_map_glb, weights_glb, 0, OMRtwoM);
+    formLhsWeights(lhs, pertinentIndices, OMRtwoM, repeatition_glb, seed);
 
     // 4. 求解方程 - Solving equation
-    auto newrhs = equationSolving(lhs, rhs, payloadSize);
+    auto newrhs = peelingEquationSolving(lhs, rhs, payloadSize, numcores);
 
     return newrhs;                               // 返回新的右侧结果 - Return new right-hand side result
 }
@@ -247,23 +358,24 @@ vector<vector<long>> receiverDecoding(Ciphertext& lhsEnc, vector<vector<int>>& b
  * OMR3的接收方解码函数 - Receiver decoding function for OMR3
  * @param lhsEnc 加密的左侧数据向量 - Encrypted left-hand side data vector
  * @param lhsCounter 左侧计数器 - Left-hand side counter
- * @param bipartite_map 二分图映射 - Bipartite map
  * @param rhsEnc 加密的右侧数据 - Encrypted right-hand side data
  * @param degree 多项式度数 - Polynomial degree
  * @param secret_key 密钥 - Secret key
  * @param context SEAL上下文 - SEAL context
  * @param numOfTransactions 交易数量 - Number of transactions
- * @param seed 随机种子 - Random seed
+ * @param seed 检测者分配桶时使用的种子 - Seed the detector assigned the buckets with
+ * @param indexBase 范围查询的起始消息 - First message of a range query
  * @param payloadUpperBound 载荷上界 - Payload upper bound
  * @param payloadSize 载荷大小 - Payload size
  * @return 返回解码后的数据 - Returns decoded data
  */
-vector<vector<long>> receiverDecodingOMR3(vector<vector<Ciphertext>>& lhsEnc, vector<Ciphertext>& lhsCounter, vector<vector<int>>& bipartite_map, Ciphertext& rhsEnc,
-                        const size_t& degree, const SecretKey& secret_key, const SEALContext& context, const int numOfTransactions, int seed = 3,
+vector<vector<long>> receiverDecodingOMR3(vector<vector<Ciphertext>>& lhsEnc, vector<Ciphertext>& lhsCounter, Ciphertext& rhsEnc,
+                        const size_t& degree, const SecretKey& secret_key, const SEALContext& context, const int numOfTransactions,
+                        const int seed, const int indexBase = 0,
                         const int payloadUpperBound = 306, const int payloadSize = 306){
     // 1. 查找相关索引 - Find pertinent indices
     map<int, int> pertinentIndices;              // 相关索引映射 - Pertinent indices map
-    decodeIndicesRandom(pertinentIndices, lhsEnc, lhsCounter, degree, secret_key, context);
+    decodeIndicesRandom(pertinentIndices, lhsEnc, lhsCounter, degree, secret_key, context, indexBase);
     // 输出找到的所有索引 - Print out all the indices found
     for (map<int, int>::iterator it = pertinentIndices.begin(); it != pertinentIndices.end(); it++)
     {
@@ -277,10 +389,10 @@ vector<vector<long>> receiverDecodingOMR3(vector<vector<Ciphertext>>& lhsEnc, ve
 
     // 3. 构建左侧方程 - Forming left-hand side
     vector<vector<int>> lhs;                     // 左侧方程组 - Left-hand side equations
-    formLhsWeights(lhs, pertinentIndices, bipartite_map_glb, weights_glb, 0, OMRthreeM);
+    formLhsWeights(lhs, pertinentIndices, OMRthreeM, repeatition_glb, seed);
 
     // 4. 求解方程 - Solving equation
-    auto newrhs = equationSolving(lhs, rhs, payloadSize);
+    auto newrhs = peelingEquationSolving(lhs, rhs, payloadSize, numcores);
 
     return newrhs;                               // 返回新的右侧结果 - Return new right-hand side result
 }
@@ -329,24 +441,9 @@ void OMDlevelspecificDetectKeySize(){
     auto params = PVWParam(450, 65537, 1.3, 16000, 4);  // PVW参数设置 - PVW parameter setup
     auto sk = PVWGenerateSecretKey(params);              // 生成PVW私钥 - Generate PVW secret key
     cout << "Finishing generating sk for PVW cts\n";
-    EncryptionParameters parms(scheme_type::bfv);        // BFV加密参数 - BFV encryption parameters
-    size_t poly_modulus_degree = poly_modulus_degree_glb; // 多项式模数度 - Polynomial modulus degree
-    parms.set_poly_modulus_degree(poly_modulus_degree);
-    // 创建系数模数 - Create coefficient modulus
-    auto coeff_modulus = CoeffModulus::Create(poly_modulus_degree, { 28,
-                                                                            39, 60, 60, 60,
-                                                                            60, 60, 60, 60, 60, 60,
-                                                                            32, 30, 60 });
-    parms.set_coeff_modulus(coeff_modulus);
-    parms.set_plain_modulus(65537);                      // 设置明文模数 - Set plain modulus
-
-	prng_seed_type seed;                                 // 伪随机数生成器种子 - PRNG seed
-    for (auto &i : seed)
-    {
-        i = random_uint64();                             // 生成随机种子 - Generate random seed
-    }
-    auto rng = make_shared<Blake2xbPRNGFactory>(Blake2xbPRNGFactory(seed));
-    parms.set_random_generator(rng);                     // 设置随机数生成器 - Set random generator
+    auto profile = selectParamProfile(num_of_pertinent_msgs_glb, 306, false, params); // 参数配置 - Parameter profile
+    EncryptionParameters parms = profileEncryptionParameters(profile); // BFV加密参数 - BFV encryption parameters
+    size_t poly_modulus_degree = profile.poly_modulus_degree; // 多项式模数度 - Polynomial modulus degree
 
     SEALContext context(parms, true, sec_level_type::none); // 创建SEAL上下文 - Create SEAL context
     print_parameters(context);                           // 打印参数 - Print parameters
@@ -395,26 +492,9 @@ void levelspecificDetectKeySize(){
     auto sk = PVWGenerateSecretKey(params);              // 生成PVW私钥 - Generate PVW secret key
     cout << "Finishing generating sk for PVW cts\n";
 
-    EncryptionParameters parms(scheme_type::bfv);        // BFV加密参数 - BFV encryption parameters
-    size_t poly_modulus_degree = poly_modulus_degree_glb; // 多项式模数度 - Polynomial modulus degree
-    auto degree = poly_modulus_degree;                   // 度数 - Degree
-    parms.set_poly_modulus_degree(poly_modulus_degree);
-    // 创建系数模数 - Create coefficient modulus
-    auto coeff_modulus = CoeffModulus::Create(poly_modulus_degree, { 28,
-                                                                            39, 60, 60, 60, 60,
-                                                                            60, 60, 60, 60, 60, 60,
-                                                                            32, 30, 60 });
-    parms.set_coeff_modulus(coeff_modulus);
-    parms.set_plain_modulus(65537);
-
-
-	prng_seed_type seed;
-    for (auto &i : seed)
-    {
-        i = random_uint64();
-    }
-    auto rng = make_shared<Blake2xbPRNGFactory>(Blake2xbPRNGFactory(seed));
-    parms.set_random_generator(rng);
+    auto profile = selectParamProfile(num_of_pertinent_msgs_glb, 306, true, params); // 参数配置 - Parameter profile
+    EncryptionParameters parms = profileEncryptionParameters(profile); // BFV加密参数 - BFV encryption parameters
+    size_t poly_modulus_degree = profile.poly_modulus_degree; // 多项式模数度 - Polynomial modulus degree
 
     SEALContext context(parms, true, sec_level_type::none);
     print_parameters(context); 
@@ -434,41 +514,16 @@ void levelspecificDetectKeySize(){
 	    steps.push_back(i);
     }
 
+    auto time_start = chrono::high_resolution_clock::now();
     stringstream lvlRTK, lvlRTK2;
     /////////////////////////////////////// Level specific keys
-    vector<Modulus> coeff_modulus_next = coeff_modulus;
-    coeff_modulus_next.erase(coeff_modulus_next.begin() + 3, coeff_modulus_next.end()-1);
-    EncryptionParameters parms_next = parms;
-    parms_next.set_coeff_modulus(coeff_modulus_next);
-    parms_next.set_random_generator(rng);
-    SEALContext context_next = SEALContext(parms_next, true, sec_level_type::none);
-
-    SecretKey sk_next;
-    sk_next.data().resize(coeff_modulus_next.size() * degree);
-    sk_next.parms_id() = context_next.key_parms_id();
-    util::set_poly(secret_key.data().data(), degree, coeff_modulus_next.size() - 1, sk_next.data().data());
-    util::set_poly(
-        secret_key.data().data() + degree * (coeff_modulus.size() - 1), degree, 1,
-        sk_next.data().data() + degree * (coeff_modulus_next.size() - 1));
-    KeyGenerator keygen_next(context_next, sk_next); 
+    SEALContext context_next = levelSpecificContext(parms, profile.next_primes);
+    KeyGenerator keygen_next(context_next, levelSpecificSecretKey(secret_key, context, context_next)); 
     vector<int> steps_next = {0,1};
     auto reskeysize = keygen_next.create_galois_keys(steps_next).save(lvlRTK);
         //////////////////////////////////////
-    vector<Modulus> coeff_modulus_last = coeff_modulus;
-    coeff_modulus_last.erase(coeff_modulus_last.begin() + 2, coeff_modulus_last.end()-1);
-    EncryptionParameters parms_last = parms;
-    parms_last.set_coeff_modulus(coeff_modulus_last);
-    parms_last.set_random_generator(rng);
-    SEALContext context_last = SEALContext(parms_last, true, sec_level_type::none);
-
-    SecretKey sk_last;
-    sk_last.data().resize(coeff_modulus_last.size() * degree);
-    sk_last.parms_id() = context_last.key_parms_id();
-    util::set_poly(secret_key.data().data(), degree, coeff_modulus_last.size() - 1, sk_last.data().data());
-    util::set_poly(
-        secret_key.data().data() + degree * (coeff_modulus.size() - 1), degree, 1,
-        sk_last.data().data() + degree * (coeff_modulus_last.size() - 1));
-    KeyGenerator keygen_last(context_last, sk_last); 
+    SEALContext context_last = levelSpecificContext(parms, profile.last_primes);
+    KeyGenerator keygen_last(context_last, levelSpecificSecretKey(secret_key, context, context_last)); 
     reskeysize += keygen_last.create_galois_keys(steps).save(lvlRTK2);
     //////////////////////////////////////
 
@@ -487,13 +542,29 @@ void levelspecificDetectKeySize(){
     for(size_t i = 0; i < switchingKeypacked.size(); i++){
         reskeysize += switchingKeypacked[i].save(data_stream);
     }
+    auto time_end = chrono::high_resolution_clock::now();
     cout << "Detection Key Size: " << reskeysize << " bytes" << endl;
+    cout << "Serial key generation: " << chrono::duration_cast<chrono::microseconds>(time_end - time_start).count() << "us." << endl;
+
+    // 并行生成并流式写入密钥文件 - Generate in parallel and stream to the key file
+    NTL::SetNumThreads(max(1, int(thread::hardware_concurrency())));
+    time_start = chrono::high_resolution_clock::now();
+    ofstream keyFile("../data/detection_key.bin", ios::binary);
+    SEALContext context_packed = levelSpecificContext(parms, rangeCheckOutputPrimes(profile));
+    auto keyFileSize = generateDetectionKey(keyFile, context, context_next, context_last, context_packed, secret_key, sk, params);
+    keyFile.close();
+    time_end = chrono::high_resolution_clock::now();
+    cout << "Parallel key generation: " << chrono::duration_cast<chrono::microseconds>(time_end - time_start).count() << "us, "
+         << keyFileSize << " bytes streamed." << endl;
+
+    LazyDetectionKey detectionKey(context, context_next, context_last, context_packed, params);
+    ifstream keyFileIn("../data/detection_key.bin", ios::binary);
+    if(detectionKey.load(keyFileIn))
+        cout << "Detection key file loaded, " << detectionKey.pendingParts() << " parts left seeded." << endl;
 }
 
 void OMD1p(){
 
-    size_t poly_modulus_degree = poly_modulus_degree_glb;
-
     int numOfTransactions = numOfTransactions_glb;
     createDatabase(numOfTransactions, 306); // one time; note that this 306 represents 612 bytes because each slot can contain 2 bytes
     cout << "Finishing createDatabase\n";
@@ -513,26 +584,15 @@ void OMD1p(){
 
     // step 3. generate detection key
     // recipient side
-    EncryptionParameters parms(scheme_type::bfv);
-    parms.set_poly_modulus_degree(poly_modulus_degree);
-    auto coeff_modulus = CoeffModulus::Create(poly_modulus_degree, { 28, 
-                                                                            39, 60, 60, 60, 
-                                                                            60, 60, 60, 60, 60, 60,
-                                                                            32, 30, 60 });
-    parms.set_coeff_modulus(coeff_modulus);
-    parms.set_plain_modulus(65537);
-
-
-	prng_seed_type seed;
-    for (auto &i : seed)
-    {
-        i = random_uint64();
-    }
-    auto rng = make_shared<Blake2xbPRNGFactory>(Blake2xbPRNGFactory(seed));
-    parms.set_random_generator(rng);
+    auto profile = selectParamProfile(num_of_pertinent_msgs_glb, 306, false, params);
+    size_t poly_modulus_degree = profile.poly_modulus_degree;
+    EncryptionParameters parms = profileEncryptionParameters(profile);
 
     SEALContext context(parms, true, sec_level_type::none);
     print_parameters(context); 
+    // 模数级别计划 - Modulus level plan
+    DetectionLevelPlan levelPlan(context, params, numOfTransactions, false);
+    levelPlan.planner.report();
     KeyGenerator keygen(context);
     SecretKey secret_key = keygen.secret_key();
     PublicKey public_key;
@@ -560,6 +620,11 @@ void OMD1p(){
     // only one rot key is needed for full level
     keygen.create_galois_keys(stepsfirst, gal_keys);
 
+    // server side: rotations of the switching keys, reused by every batch
+    RotatedSwitchingKeyCache switchingKeyCache(switchingKey, gal_keys, context, params,
+                                            RotatedSwitchingKeyCache::rotationsWithinBudget(switchingKeyCacheBytes_glb, context, params),
+                                            switchingKeyCacheSpill_glb);
+
     cout << "Finishing generating detection keys\n";
 
     vector<vector<Ciphertext>> packedSICfromPhase1(numcores,vector<Ciphertext>(numOfTransactions/numcores/poly_modulus_degree)); // Assume numOfTransactions/numcores/poly_modulus_degree is integer, pad if needed
@@ -581,7 +646,7 @@ void OMD1p(){
         while(j < numOfTransactions/numcores/poly_modulus_degree){
             cout << "OMD, Batch " << j << endl;
             loadClues(SICPVW_multicore[i], counter[i], counter[i]+poly_modulus_degree, params);
-            packedSICfromPhase1[i][j] = serverOperations1obtainPackedSIC(SICPVW_multicore[i], switchingKey, relin_keys, gal_keys,
+            packedSICfromPhase1[i][j] = serverOperations1obtainPackedSIC(SICPVW_multicore[i], switchingKeyCache, relin_keys,
                                                             poly_modulus_degree, context, params, poly_modulus_degree);
             j++;
             counter[i] += poly_modulus_degree;
@@ -617,6 +682,15 @@ void OMD1p(){
     time_diff = chrono::duration_cast<chrono::microseconds>(time_end - time_start);
     cout << "\nDetector runnimg time: " << time_diff.count() << "us." << "\n";
 
+    // 默认只做按位打包；舍去低位的预算由持有私钥的接收者测量 - Bit-packing only by default; the budget for dropping low bits is measured by the recipient holding the key
+    double digestBudget = 0;
+    if(compactDigestMeasuredBudget_glb)
+        digestBudget = measuredNoiseBudget(decryptor, context, res);
+    stringstream data_streamdg, compact_streamdg;
+    cout << "Digest size: " << res.save(data_streamdg) << " bytes" << endl;
+    cout << "Compact digest size: " << saveCompactDigest(res, context, digestBudget, compact_streamdg) << " bytes" << endl;
+    loadCompactDigest(res, context, compact_streamdg);
+
     // step 5. receiver decoding
     time_start = chrono::high_resolution_clock::now();
     auto realres = decodeIndicesOMD(res, numOfTransactions, poly_modulus_degree, secret_key, context);
@@ -653,8 +727,6 @@ void OMD1p(){
 
 void OMR2(){
 
-    size_t poly_modulus_degree = poly_modulus_degree_glb;
-
     int numOfTransactions = numOfTransactions_glb;
     createDatabase(numOfTransactions, 306); 
     cout << "Finishing createDatabase\n";
@@ -672,27 +744,15 @@ void OMR2(){
 
     // step 3. generate detection key
     // recipient side
-    EncryptionParameters parms(scheme_type::bfv);
-    auto degree = poly_modulus_degree;
-    parms.set_poly_modulus_degree(poly_modulus_degree);
-    auto coeff_modulus = CoeffModulus::Create(poly_modulus_degree, { 28, 
-                                                                            39, 60, 60, 60, 60, 
-                                                                            60, 60, 60, 60, 60, 60,
-                                                                            32, 30, 60 });
-    parms.set_coeff_modulus(coeff_modulus);
-    parms.set_plain_modulus(65537);
-
-
-	prng_seed_type seed;
-    for (auto &i : seed)
-    {
-        i = random_uint64();
-    }
-    auto rng = make_shared<Blake2xbPRNGFactory>(Blake2xbPRNGFactory(seed));
-    parms.set_random_generator(rng);
+    auto profile = selectParamProfile(num_of_pertinent_msgs_glb, 306, true, params);
+    size_t poly_modulus_degree = profile.poly_modulus_degree;
+    EncryptionParameters parms = profileEncryptionParameters(profile);
 
     SEALContext context(parms, true, sec_level_type::none);
     print_parameters(context); 
+    // 模数级别计划 - Modulus level plan
+    DetectionLevelPlan levelPlan(context, params, numOfTransactions, true);
+    levelPlan.planner.report();
     KeyGenerator keygen(context);
     SecretKey secret_key = keygen.secret_key();
     PublicKey public_key;
@@ -719,6 +779,11 @@ void OMR2(){
     // only one rot key is needed for full level
     keygen.create_galois_keys(stepsfirst, gal_keys);
 
+    // server side: rotations of the switching keys, reused by every batch
+    RotatedSwitchingKeyCache switchingKeyCache(switchingKey, gal_keys, context, params,
+                                            RotatedSwitchingKeyCache::rotationsWithinBudget(switchingKeyCacheBytes_glb, context, params),
+                                            switchingKeyCacheSpill_glb);
+
     /////////////////////////////////////////////////////////////// Rot Key gen
     vector<int> steps = {0};
     for(int i = 1; i < int(poly_modulus_degree/2); i *= 2){
@@ -728,37 +793,13 @@ void OMR2(){
     cout << "Finishing generating detection keys\n";
 
     /////////////////////////////////////// Level specific keys
-    vector<Modulus> coeff_modulus_next = coeff_modulus;
-    coeff_modulus_next.erase(coeff_modulus_next.begin() + 4, coeff_modulus_next.end()-1);
-    EncryptionParameters parms_next = parms;
-    parms_next.set_coeff_modulus(coeff_modulus_next);
-    SEALContext context_next = SEALContext(parms_next, true, sec_level_type::none);
-
-    SecretKey sk_next;
-    sk_next.data().resize(coeff_modulus_next.size() * degree);
-    sk_next.parms_id() = context_next.key_parms_id();
-    util::set_poly(secret_key.data().data(), degree, coeff_modulus_next.size() - 1, sk_next.data().data());
-    util::set_poly(
-        secret_key.data().data() + degree * (coeff_modulus.size() - 1), degree, 1,
-        sk_next.data().data() + degree * (coeff_modulus_next.size() - 1));
-    KeyGenerator keygen_next(context_next, sk_next); 
+    SEALContext context_next = levelSpecificContext(parms, profile.next_primes);
+    KeyGenerator keygen_next(context_next, levelSpecificSecretKey(secret_key, context, context_next)); 
     vector<int> steps_next = {0,1};
     keygen_next.create_galois_keys(steps_next, gal_keys_next);
         //////////////////////////////////////
-    vector<Modulus> coeff_modulus_last = coeff_modulus;
-    coeff_modulus_last.erase(coeff_modulus_last.begin() + 2, coeff_modulus_last.end()-1);
-    EncryptionParameters parms_last = parms;
-    parms_last.set_coeff_modulus(coeff_modulus_last);
-    SEALContext context_last = SEALContext(parms_last, true, sec_level_type::none);
-
-    SecretKey sk_last;
-    sk_last.data().resize(coeff_modulus_last.size() * degree);
-    sk_last.parms_id() = context_last.key_parms_id();
-    util::set_poly(secret_key.data().data(), degree, coeff_modulus_last.size() - 1, sk_last.data().data());
-    util::set_poly(
-        secret_key.data().data() + degree * (coeff_modulus.size() - 1), degree, 1,
-        sk_last.data().data() + degree * (coeff_modulus_last.size() - 1));
-    KeyGenerator keygen_last(context_last, sk_last); 
+    SEALContext context_last = levelSpecificContext(parms, profile.last_primes);
+    KeyGenerator keygen_last(context_last, levelSpecificSecretKey(secret_key, context, context_last)); 
     keygen_last.create_galois_keys(steps, gal_keys_last);
     //////////////////////////////////////
 
@@ -782,7 +823,7 @@ void OMR2(){
             if(!i)
                 cout << "Phase 1, Core " << i << ", Batch " << j << endl;
             loadClues(SICPVW_multicore[i], counter[i], counter[i]+poly_modulus_degree, params);
-            packedSICfromPhase1[i][j] = serverOperations1obtainPackedSIC(SICPVW_multicore[i], switchingKey, relin_keys, gal_keys,
+            packedSICfromPhase1[i][j] = serverOperations1obtainPackedSIC(SICPVW_multicore[i], switchingKeyCache, relin_keys,
                                                             poly_modulus_degree, context, params, poly_modulus_degree);
             j++;
             counter[i] += poly_modulus_degree;
@@ -794,10 +835,9 @@ void OMR2(){
     MemoryManager::SwitchProfile(std::move(old_prof));
 
     // step 4. detector operations
-    vector<Ciphertext> lhs_multi(numcores), rhs_multi(numcores);
-    vector<vector<vector<int>>> bipartite_map(numcores);
-
-    bipartiteGraphWeightsGeneration(bipartite_map_glb, weights_glb, numOfTransactions,OMRtwoM,repeatition_glb,seed_glb);
+    vector<vector<Ciphertext>> lhs_multi(numcores);
+    vector<Ciphertext> rhs_multi(numcores);
+    vector<vector<vector<int>>> bipartite_map(numcores); // 每个核心当前批次的窗口 - Window of the current batch per core
 
     NTL_EXEC_RANGE(numcores, first, last);
     for(int i = first; i < last; i++){
@@ -810,15 +850,15 @@ void OMR2(){
             if(!i)
                 cout << "Phase 2-3, Core " << i << ", Batch " << j << endl;
             loadData(payload_multicore[i], counter[i], counter[i]+poly_modulus_degree);
-            Ciphertext templhs, temprhs;
+            vector<Ciphertext> templhs;
+            Ciphertext temprhs;
             serverOperations2therest(templhs, bipartite_map[i], temprhs,
                             packedSICfromPhase1[i][j], payload_multicore[i], relin_keys, gal_keys_next,
                             poly_modulus_degree, context_next, context_last, params, poly_modulus_degree, counter[i]);
+            addIndexBlocks(lhs_multi[i], templhs, evaluator);
             if(j == 0){
-                lhs_multi[i] = templhs;
                 rhs_multi[i] = temprhs;
             } else {
-                evaluator.add_inplace(lhs_multi[i], templhs);
                 evaluator.add_inplace(rhs_multi[i], temprhs);
             }
             j++;
@@ -830,13 +870,14 @@ void OMR2(){
     NTL_EXEC_RANGE_END;
 
     for(int i = 1; i < numcores; i++){
-        evaluator.add_inplace(lhs_multi[0], lhs_multi[i]);
+        addIndexBlocks(lhs_multi[0], lhs_multi[i], evaluator);
         evaluator.add_inplace(rhs_multi[0], rhs_multi[i]);
     }
 
-    while(context.last_parms_id() != lhs_multi[0].parms_id()){
+    while(context.last_parms_id() != rhs_multi[0].parms_id()){
             evaluator.mod_switch_to_next_inplace(rhs_multi[0]);
-            evaluator.mod_switch_to_next_inplace(lhs_multi[0]);
+            for(size_t k = 0; k < lhs_multi[0].size(); k++)
+                evaluator.mod_switch_to_next_inplace(lhs_multi[0][k]);
         }
 
     time_end = chrono::high_resolution_clock::now();
@@ -844,13 +885,46 @@ void OMR2(){
     cout << "\nDetector runnimg time: " << time_diff.count() << "us." << "\n";
 
     stringstream data_streamdg, data_streamdg2;
-    cout << "Digest size: " << rhs_multi[0].save(data_streamdg) + lhs_multi[0].save(data_streamdg2) << " bytes" << endl;
+    auto digsize = rhs_multi[0].save(data_streamdg);
+    for(size_t k = 0; k < lhs_multi[0].size(); k++){
+        digsize += lhs_multi[0][k].save(data_streamdg2);
+    }
+    cout << "Digest size: " << digsize << " bytes, " << lhs_multi[0].size() << " index block(s)" << endl;
+
+    // 默认只做按位打包；舍去低位的预算由持有私钥的接收者测量 - Bit-packing only by default; the budget for dropping low bits is measured by the recipient holding the key
+    double digestBudget = 0;
+    if(compactDigestMeasuredBudget_glb){
+        digestBudget = measuredNoiseBudget(decryptor, context, rhs_multi[0]);
+        for(size_t k = 0; k < lhs_multi[0].size(); k++){
+            digestBudget = min(digestBudget, double(measuredNoiseBudget(decryptor, context, lhs_multi[0][k])));
+        }
+    }
+    stringstream compact_streamdg;
+    auto compactsize = saveCompactDigest(rhs_multi[0], context, digestBudget, compact_streamdg);
+    for(size_t k = 0; k < lhs_multi[0].size(); k++){
+        compactsize += saveCompactDigest(lhs_multi[0][k], context, digestBudget, compact_streamdg);
+    }
+    cout << "Compact digest size: " << compactsize << " bytes" << endl;
+
+    // 独立接收者程序的输入，见recipient.cpp - Input of the standalone recipient program, see recipient.cpp
+    RecipientDigest recipientDigest;
+    recipientDigest.numOfTransactions = numOfTransactions;
+    recipientDigest.num_of_buckets = OMRtwoM;
+    recipientDigest.repetition = repeatition_glb;
+    recipientDigest.seed = seed_glb;
+    recipientDigest.rhs = rhs_multi[0];
+    recipientDigest.lhs = lhs_multi[0];
+    saveRecipientBundle(recipientDigest, parms, secret_key, context, digestBudget);
+
+    loadCompactDigest(rhs_multi[0], context, compact_streamdg);
+    for(size_t k = 0; k < lhs_multi[0].size(); k++){
+        loadCompactDigest(lhs_multi[0][k], context, compact_streamdg);
+    }
 
     // step 5. receiver decoding
-    bipartiteGraphWeightsGeneration(bipartite_map_glb, weights_glb, numOfTransactions,OMRtwoM,repeatition_glb,seed_glb);
     time_start = chrono::high_resolution_clock::now();
-    auto res = receiverDecoding(lhs_multi[0], bipartite_map[0], rhs_multi[0],
-                        poly_modulus_degree, secret_key, context, numOfTransactions);
+    auto res = receiverDecoding(lhs_multi[0], rhs_multi[0],
+                        poly_modulus_degree, secret_key, context, numOfTransactions, seed_glb);
     time_end = chrono::high_resolution_clock::now();
     time_diff = chrono::duration_cast<chrono::microseconds>(time_end - time_start);
     cout << "\nRecipient runnimg time: " << time_diff.count() << "us." << "\n";
@@ -863,8 +937,6 @@ void OMR2(){
 
 void OMR3(){
 
-    size_t poly_modulus_degree = poly_modulus_degree_glb;
-
     int numOfTransactions = numOfTransactions_glb;
     createDatabase(numOfTransactions, 306); 
     cout << "Finishing createDatabase\n";
@@ -884,27 +956,15 @@ void OMR3(){
 
     // step 3. generate detection key
     // recipient side
-    EncryptionParameters parms(scheme_type::bfv);
-    auto degree = poly_modulus_degree;
-    parms.set_poly_modulus_degree(poly_modulus_degree);
-    auto coeff_modulus = CoeffModulus::Create(poly_modulus_degree, { 28, 
-                                                                            39, 60, 60, 60, 60, 
-                                                                            60, 60, 60, 60, 60, 60,
-                                                                            32, 30, 60 });
-    parms.set_coeff_modulus(coeff_modulus);
-    parms.set_plain_modulus(65537);
-
-
-	prng_seed_type seed;
-    for (auto &i : seed)
-    {
-        i = random_uint64();
-    }
-    auto rng = make_shared<Blake2xbPRNGFactory>(Blake2xbPRNGFactory(seed));
-    parms.set_random_generator(rng);
+    auto profile = selectParamProfile(num_of_pertinent_msgs_glb, 306, true, params);
+    size_t poly_modulus_degree = profile.poly_modulus_degree;
+    EncryptionParameters parms = profileEncryptionParameters(profile);
 
     SEALContext context(parms, true, sec_level_type::none);
     print_parameters(context); 
+    // 模数级别计划 - Modulus level plan
+    DetectionLevelPlan levelPlan(context, params, numOfTransactions, true);
+    levelPlan.planner.report();
     KeyGenerator keygen(context);
     SecretKey secret_key = keygen.secret_key();
     PublicKey public_key;
@@ -930,6 +990,11 @@ void OMR3(){
     vector<int> stepsfirst = {1};
     keygen.create_galois_keys(stepsfirst, gal_keys);
 
+    // server side: rotations of the switching keys, reused by every batch
+    RotatedSwitchingKeyCache switchingKeyCache(switchingKey, gal_keys, context, params,
+                                            RotatedSwitchingKeyCache::rotationsWithinBudget(switchingKeyCacheBytes_glb, context, params),
+                                            switchingKeyCacheSpill_glb);
+
     /////////////////////////////////////////////////////////////// Rot Key gen
     vector<int> steps = {0};
     for(int i = 1; i < int(poly_modulus_degree/2); i *= 2){
@@ -939,37 +1004,13 @@ void OMR3(){
     cout << "Finishing generating detection keys\n";
 
     /////////////////////////////////////// Level specific keys
-    vector<Modulus> coeff_modulus_next = coeff_modulus;
-    coeff_modulus_next.erase(coeff_modulus_next.begin() + 4, coeff_modulus_next.end()-1);
-    EncryptionParameters parms_next = parms;
-    parms_next.set_coeff_modulus(coeff_modulus_next);
-    SEALContext context_next = SEALContext(parms_next, true, sec_level_type::none);
-
-    SecretKey sk_next;
-    sk_next.data().resize(coeff_modulus_next.size() * degree);
-    sk_next.parms_id() = context_next.key_parms_id();
-    util::set_poly(secret_key.data().data(), degree, coeff_modulus_next.size() - 1, sk_next.data().data());
-    util::set_poly(
-        secret_key.data().data() + degree * (coeff_modulus.size() - 1), degree, 1,
-        sk_next.data().data() + degree * (coeff_modulus_next.size() - 1));
-    KeyGenerator keygen_next(context_next, sk_next); 
+    SEALContext context_next = levelSpecificContext(parms, profile.next_primes);
+    KeyGenerator keygen_next(context_next, levelSpecificSecretKey(secret_key, context, context_next)); 
     vector<int> steps_next = {0,1};
     keygen_next.create_galois_keys(steps_next, gal_keys_next);
         //////////////////////////////////////
-    vector<Modulus> coeff_modulus_last = coeff_modulus;
-    coeff_modulus_last.erase(coeff_modulus_last.begin() + 2, coeff_modulus_last.end()-1);
-    EncryptionParameters parms_last = parms;
-    parms_last.set_coeff_modulus(coeff_modulus_last);
-    SEALContext context_last = SEALContext(parms_last, true, sec_level_type::none);
-
-    SecretKey sk_last;
-    sk_last.data().resize(coeff_modulus_last.size() * degree);
-    sk_last.parms_id() = context_last.key_parms_id();
-    util::set_poly(secret_key.data().data(), degree, coeff_modulus_last.size() - 1, sk_last.data().data());
-    util::set_poly(
-        secret_key.data().data() + degree * (coeff_modulus.size() - 1), degree, 1,
-        sk_last.data().data() + degree * (coeff_modulus_last.size() - 1));
-    KeyGenerator keygen_last(context_last, sk_last); 
+    SEALContext context_last = levelSpecificContext(parms, profile.last_primes);
+    KeyGenerator keygen_last(context_last, levelSpecificSecretKey(secret_key, context, context_last)); 
     keygen_last.create_galois_keys(steps, gal_keys_last);
     PublicKey public_key_last;
     keygen_last.create_public_key(public_key_last);
@@ -996,7 +1037,7 @@ void OMR3(){
             if(!i)
                 cout << "Phase 1, Core " << i << ", Batch " << j << endl;
             loadClues(SICPVW_multicore[i], counter[i], counter[i]+poly_modulus_degree, params);
-            packedSICfromPhase1[i][j] = serverOperations1obtainPackedSIC(SICPVW_multicore[i], switchingKey, relin_keys, gal_keys,
+            packedSICfromPhase1[i][j] = serverOperations1obtainPackedSIC(SICPVW_multicore[i], switchingKeyCache, relin_keys,
                                                             poly_modulus_degree, context, params, poly_modulus_degree);
             j++;
             counter[i] += poly_modulus_degree;
@@ -1012,9 +1053,7 @@ void OMR3(){
     vector<vector<vector<Ciphertext>>> lhs_multi(numcores);
     vector<vector<Ciphertext>> lhs_multi_ctr(numcores);
     vector<Ciphertext> rhs_multi(numcores);
-    vector<vector<vector<int>>> bipartite_map(numcores);
-
-    bipartiteGraphWeightsGeneration(bipartite_map_glb, weights_glb, numOfTransactions,OMRtwoM,repeatition_glb,seed_glb);
+    vector<vector<vector<int>>> bipartite_map(numcores); // 每个核心当前批次的窗口 - Window of the current batch per core
 
 
     NTL_EXEC_RANGE(numcores, first, last);
@@ -1097,11 +1136,57 @@ void OMR3(){
     }
     cout << "Digest size: " << digsize << " bytes" << endl;
 
+    // 默认只做按位打包；舍去低位的预算由持有私钥的接收者测量 - Bit-packing only by default; the budget for dropping low bits is measured by the recipient holding the key
+    double digestBudget = 0;
+    if(compactDigestMeasuredBudget_glb){
+        digestBudget = measuredNoiseBudget(decryptor, context, rhs_multi[0]);
+        for(size_t q = 0; q < lhs_multi[0].size(); q++){
+            for(size_t w = 0; w < lhs_multi[0][q].size(); w++){
+                digestBudget = min(digestBudget, double(measuredNoiseBudget(decryptor, context, lhs_multi[0][q][w])));
+            }
+        }
+        for(size_t q = 0; q < lhs_multi_ctr[0].size(); q++){
+            digestBudget = min(digestBudget, double(measuredNoiseBudget(decryptor, context, lhs_multi_ctr[0][q])));
+        }
+    }
+    stringstream compact_streamdg;
+    auto compactsize = saveCompactDigest(rhs_multi[0], context, digestBudget, compact_streamdg);
+    for(size_t q = 0; q < lhs_multi[0].size(); q++){
+        for(size_t w = 0; w < lhs_multi[0][q].size(); w++){
+            compactsize += saveCompactDigest(lhs_multi[0][q][w], context, digestBudget, compact_streamdg);
+        }
+    }
+    for(size_t q = 0; q < lhs_multi_ctr[0].size(); q++){
+        compactsize += saveCompactDigest(lhs_multi_ctr[0][q], context, digestBudget, compact_streamdg);
+    }
+    cout << "Compact digest size: " << compactsize << " bytes" << endl;
+
+    // 独立接收者程序的输入，见recipient.cpp - Input of the standalone recipient program, see recipient.cpp
+    RecipientDigest recipientDigest;
+    recipientDigest.randomized = true;
+    recipientDigest.numOfTransactions = numOfTransactions;
+    recipientDigest.num_of_buckets = OMRthreeM;
+    recipientDigest.repetition = repeatition_glb;
+    recipientDigest.seed = seed_glb;
+    recipientDigest.rhs = rhs_multi[0];
+    recipientDigest.lhsRandom = lhs_multi[0];
+    recipientDigest.lhsCounter = lhs_multi_ctr[0];
+    saveRecipientBundle(recipientDigest, parms, secret_key, context, digestBudget);
+
+    loadCompactDigest(rhs_multi[0], context, compact_streamdg);
+    for(size_t q = 0; q < lhs_multi[0].size(); q++){
+        for(size_t w = 0; w < lhs_multi[0][q].size(); w++){
+            loadCompactDigest(lhs_multi[0][q][w], context, compact_streamdg);
+        }
+    }
+    for(size_t q = 0; q < lhs_multi_ctr[0].size(); q++){
+        loadCompactDigest(lhs_multi_ctr[0][q], context, compact_streamdg);
+    }
+
     // step 5. receiver decoding
-    bipartiteGraphWeightsGeneration(bipartite_map_glb, weights_glb, numOfTransactions,OMRtwoM,repeatition_glb,seed_glb);
     time_start = chrono::high_resolution_clock::now();
-    auto res = receiverDecodingOMR3(lhs_multi[0], lhs_multi_ctr[0], bipartite_map[0], rhs_multi[0],
-                        poly_modulus_degree, secret_key, context, numOfTransactions);
+    auto res = receiverDecodingOMR3(lhs_multi[0], lhs_multi_ctr[0], rhs_multi[0],
+                        poly_modulus_degree, secret_key, context, numOfTransactions, seed_glb);
     time_end = chrono::high_resolution_clock::now();
     time_diff = chrono::duration_cast<chrono::microseconds>(time_end - time_start);
     cout << "\nRecipient runnimg time: " << time_diff.count() << "us." << "\n";
@@ -1117,6 +1202,741 @@ void OMR3(){
     
 }
 
+/**
+ * 流式更新的OMR1p - OMR1p with streaming updates
+ * 先扫描一半公告板并保存累加器状态，然后从保存的状态继续，以不整齐的批次追加其余消息
+ * Scans half of the board and saves the accumulator state, then resumes from the saved state and appends the rest in uneven batches
+ */
+void OMR2Streaming(){
+
+    int numOfTransactions = numOfTransactions_glb;
+    createDatabase(numOfTransactions, 306); 
+    cout << "Finishing createDatabase\n";
+
+    // step 1. generate PVW sk 
+    // recipient side
+    auto params = PVWParam(450, 65537, 1.3, 16000, 4); 
+    auto sk = PVWGenerateSecretKey(params);
+    auto pk = PVWGeneratePublicKey(params, sk);
+    cout << "Finishing generating sk for PVW cts\n";
+
+    // step 2. prepare transactions
+    auto expected = preparinngTransactionsFormal(pk, numOfTransactions, num_of_pertinent_msgs_glb,  params);
+    cout << expected.size() << " pertinent msg: Finishing preparing messages\n";
+
+    // step 3. generate detection key
+    // recipient side
+    auto profile = selectParamProfile(num_of_pertinent_msgs_glb, 306, true, params);
+    size_t poly_modulus_degree = profile.poly_modulus_degree;
+    EncryptionParameters parms = profileEncryptionParameters(profile);
+
+    SEALContext context(parms, true, sec_level_type::none);
+    print_parameters(context); 
+    KeyGenerator keygen(context);
+    SecretKey secret_key = keygen.secret_key();
+    PublicKey public_key;
+    keygen.create_public_key(public_key);
+    RelinKeys relin_keys;
+    keygen.create_relin_keys(relin_keys);
+    Evaluator evaluator(context);
+
+    vector<Ciphertext> switchingKey(params.ell);
+    genSwitchingKeyPVWPacked(switchingKey, context, poly_modulus_degree, public_key, secret_key, sk, params);
+
+    GaloisKeys gal_keys;
+    vector<int> stepsfirst = {1};
+    keygen.create_galois_keys(stepsfirst, gal_keys);
+    RotatedSwitchingKeyCache switchingKeyCache(switchingKey, gal_keys, context, params,
+                                            RotatedSwitchingKeyCache::rotationsWithinBudget(switchingKeyCacheBytes_glb, context, params),
+                                            switchingKeyCacheSpill_glb);
+    Ciphertext switchingKeyPacked;
+    genSwitchingKeyPVWPackedComponents(switchingKeyPacked, context, poly_modulus_degree, public_key, secret_key, sk, params);
+
+    vector<int> steps = {0};
+    for(int i = 1; i < int(poly_modulus_degree/2); i *= 2){
+	    steps.push_back(i);
+    }
+    SEALContext context_next = levelSpecificContext(parms, profile.next_primes);
+    KeyGenerator keygen_next(context_next, levelSpecificSecretKey(secret_key, context, context_next)); 
+    vector<int> steps_next = {0,1};
+    keygen_next.create_galois_keys(steps_next, gal_keys_next);
+    SEALContext context_last = levelSpecificContext(parms, profile.last_primes);
+    KeyGenerator keygen_last(context_last, levelSpecificSecretKey(secret_key, context, context_last)); 
+    keygen_last.create_galois_keys(steps, gal_keys_last);
+    SEALContext context_packed = levelSpecificContext(parms, rangeCheckOutputPrimes(profile));
+    KeyGenerator keygen_packed(context_packed, levelSpecificSecretKey(secret_key, context, context_packed));
+    GaloisKeys gal_keys_packed;
+    keygen_packed.create_galois_keys(packedComponentsRotationSteps(poly_modulus_degree, params), gal_keys_packed);
+    cout << "Finishing generating detection keys\n";
+
+    // step 4. detector operations
+    chrono::high_resolution_clock::time_point time_start, time_end;
+    chrono::microseconds time_diff;
+
+    // first scan over half of the board
+    time_start = chrono::high_resolution_clock::now();
+    DigestAccumulator accumulator;
+    serverOperationsAppend(accumulator, numOfTransactions/2, switchingKeyCache, switchingKeyPacked, relin_keys, gal_keys_next, gal_keys_last, gal_keys_packed, public_key,
+                        poly_modulus_degree, context, context_next, context_last, context_packed, params);
+    time_end = chrono::high_resolution_clock::now();
+    time_diff = chrono::duration_cast<chrono::microseconds>(time_end - time_start);
+    cout << "\nFirst scan of " << accumulator.numOfMessages() << " messages: " << time_diff.count() << "us." << "\n";
+
+    stringstream state;
+    cout << "Accumulator state size: " << accumulator.save(state) << " bytes" << endl;
+
+    // new messages are posted: resume from the saved state and append them in uneven batches
+    DigestAccumulator resumed;
+    resumed.load(state, context);
+    int remaining = numOfTransactions - int(resumed.numOfMessages());
+    vector<int> updates = {min(1000, remaining), max(0, remaining - 1000)};
+    for(size_t i = 0; i < updates.size(); i++){
+        time_start = chrono::high_resolution_clock::now();
+        serverOperationsAppend(resumed, updates[i], switchingKeyCache, switchingKeyPacked, relin_keys, gal_keys_next, gal_keys_last, gal_keys_packed, public_key,
+                            poly_modulus_degree, context, context_next, context_last, context_packed, params);
+        time_end = chrono::high_resolution_clock::now();
+        time_diff = chrono::duration_cast<chrono::microseconds>(time_end - time_start);
+        cout << "Appending " << updates[i] << " messages: " << time_diff.count() << "us." << "\n";
+    }
+
+    vector<Ciphertext> lhs;
+    Ciphertext rhs;
+    resumed.digest(lhs, rhs, context);
+    while(context.last_parms_id() != rhs.parms_id()){
+            evaluator.mod_switch_to_next_inplace(rhs);
+            for(size_t k = 0; k < lhs.size(); k++)
+                evaluator.mod_switch_to_next_inplace(lhs[k]);
+        }
+
+    stringstream data_streamdg, data_streamdg2;
+    auto digsize = rhs.save(data_streamdg);
+    for(size_t k = 0; k < lhs.size(); k++){
+        digsize += lhs[k].save(data_streamdg2);
+    }
+    cout << "Digest size: " << digsize << " bytes" << endl;
+
+    // step 5. receiver decoding
+    time_start = chrono::high_resolution_clock::now();
+    auto res = receiverDecoding(lhs, rhs, poly_modulus_degree, secret_key, context, numOfTransactions, seed_glb);
+    time_end = chrono::high_resolution_clock::now();
+    time_diff = chrono::duration_cast<chrono::microseconds>(time_end - time_start);
+    cout << "\nRecipient runnimg time: " << time_diff.count() << "us." << "\n";
+
+    if(checkRes(expected, res))
+        cout << "Result is correct!" << endl;
+    else
+        cout << "Overflow" << endl;
+}
+
+/**
+ * 按时段部分摘要的范围查询 - Range queries over per-epoch partial digests
+ * 每个时段的部分摘要存入EpochDigestStore，压缩较早的历史，然后只对"上次查询之后"的范围求和并解码
+ * Stores the partial digest of every epoch in an EpochDigestStore, compacts the older history, then sums and decodes only the range "since the last query"
+ * 然后对同一范围运行范围限定的检测，索引相对于范围起点编码 - Then runs range-restricted detection on the same range, with indices relative to its start
+ */
+void OMR2EpochQueries(){
+
+    int numOfTransactions = numOfTransactions_glb;
+    createDatabase(numOfTransactions, 306); 
+    cout << "Finishing createDatabase\n";
+
+    // step 1. generate PVW sk 
+    // recipient side
+    auto params = PVWParam(450, 65537, 1.3, 16000, 4); 
+    auto sk = PVWGenerateSecretKey(params);
+    auto pk = PVWGeneratePublicKey(params, sk);
+    cout << "Finishing generating sk for PVW cts\n";
+
+    // step 2. prepare transactions
+    auto expected = preparinngTransactionsFormal(pk, numOfTransactions, num_of_pertinent_msgs_glb,  params);
+    cout << expected.size() << " pertinent msg: Finishing preparing messages\n";
+
+    // step 3. generate detection key
+    // recipient side
+    auto profile = selectParamProfile(num_of_pertinent_msgs_glb, 306, true, params);
+    size_t poly_modulus_degree = profile.poly_modulus_degree;
+    EncryptionParameters parms = profileEncryptionParameters(profile);
+
+    SEALContext context(parms, true, sec_level_type::none);
+    print_parameters(context); 
+    KeyGenerator keygen(context);
+    SecretKey secret_key = keygen.secret_key();
+    PublicKey public_key;
+    keygen.create_public_key(public_key);
+    RelinKeys relin_keys;
+    keygen.create_relin_keys(relin_keys);
+    Evaluator evaluator(context);
+
+    vector<Ciphertext> switchingKey(params.ell);
+    genSwitchingKeyPVWPacked(switchingKey, context, poly_modulus_degree, public_key, secret_key, sk, params);
+
+    GaloisKeys gal_keys;
+    vector<int> stepsfirst = {1};
+    keygen.create_galois_keys(stepsfirst, gal_keys);
+    RotatedSwitchingKeyCache switchingKeyCache(switchingKey, gal_keys, context, params,
+                                            RotatedSwitchingKeyCache::rotationsWithinBudget(switchingKeyCacheBytes_glb, context, params),
+                                            switchingKeyCacheSpill_glb);
+    Ciphertext switchingKeyPacked;
+    genSwitchingKeyPVWPackedComponents(switchingKeyPacked, context, poly_modulus_degree, public_key, secret_key, sk, params);
+
+    vector<int> steps = {0};
+    for(int i = 1; i < int(poly_modulus_degree/2); i *= 2){
+	    steps.push_back(i);
+    }
+    SEALContext context_next = levelSpecificContext(parms, profile.next_primes);
+    KeyGenerator keygen_next(context_next, levelSpecificSecretKey(secret_key, context, context_next)); 
+    vector<int> steps_next = {0,1};
+    keygen_next.create_galois_keys(steps_next, gal_keys_next);
+    SEALContext context_last = levelSpecificContext(parms, profile.last_primes);
+    KeyGenerator keygen_last(context_last, levelSpecificSecretKey(secret_key, context, context_last)); 
+    keygen_last.create_galois_keys(steps, gal_keys_last);
+    SEALContext context_packed = levelSpecificContext(parms, rangeCheckOutputPrimes(profile));
+    KeyGenerator keygen_packed(context_packed, levelSpecificSecretKey(secret_key, context, context_packed));
+    GaloisKeys gal_keys_packed;
+    keygen_packed.create_galois_keys(packedComponentsRotationSteps(poly_modulus_degree, params), gal_keys_packed);
+    cout << "Finishing generating detection keys\n";
+
+    // step 4. detector operations: one partial digest per epoch, 4 epochs a "day" and 4 days a "week"
+    size_t epochSize = poly_modulus_degree/4;
+    EpochDigestStore store(epochSize, {4, 4});
+    chrono::high_resolution_clock::time_point time_start, time_end;
+    chrono::microseconds time_diff;
+
+    time_start = chrono::high_resolution_clock::now();
+    for(size_t start = 0; start + epochSize <= size_t(numOfTransactions); start += epochSize){
+        DigestAccumulator epoch(false, start);
+        serverOperationsAppend(epoch, int(epochSize), switchingKeyCache, switchingKeyPacked, relin_keys, gal_keys_next, gal_keys_last, gal_keys_packed, public_key,
+                            poly_modulus_degree, context, context_next, context_last, context_packed, params);
+        vector<Ciphertext> partial(1);
+        vector<Ciphertext> indexBlocks;
+        epoch.digest(indexBlocks, partial[0], context);
+        partial.insert(partial.end(), indexBlocks.begin(), indexBlocks.end());
+        store.addEpoch(partial, start, context);
+    }
+    time_end = chrono::high_resolution_clock::now();
+    time_diff = chrono::duration_cast<chrono::microseconds>(time_end - time_start);
+    cout << "\nScanning all epochs: " << time_diff.count() << "us." << "\n";
+
+    size_t scanned = numOfTransactions - numOfTransactions % epochSize;
+    size_t since = (scanned/epochSize/3) * epochSize;  // the "last query" of this recipient
+    size_t stored = store.numOfPartials();
+    size_t dropped = store.compact(since);
+    cout << "Partial digests stored: " << stored << ", after compacting the history before message " << since << ": " << stored - dropped << endl;
+
+    time_start = chrono::high_resolution_clock::now();
+    vector<Ciphertext> digest;
+    if(!store.query(digest, since, scanned, context))
+        return;
+    Ciphertext rhs = digest[0];
+    vector<Ciphertext> lhs(digest.begin() + 1, digest.end());
+    while(context.last_parms_id() != rhs.parms_id()){
+            evaluator.mod_switch_to_next_inplace(rhs);
+            for(size_t k = 0; k < lhs.size(); k++)
+                if(lhs[k].size())
+                    evaluator.mod_switch_to_next_inplace(lhs[k]);
+        }
+    time_end = chrono::high_resolution_clock::now();
+    time_diff = chrono::duration_cast<chrono::microseconds>(time_end - time_start);
+    cout << "Query [" << since << ", " << scanned << "): " << time_diff.count() << "us." << "\n";
+
+    // step 5. receiver decoding, only the pertinent messages in the range are expected
+    auto res = receiverDecoding(lhs, rhs, poly_modulus_degree, secret_key, context, numOfTransactions, seed_glb);
+
+    vector<vector<uint64_t>> expectedInRange;
+    size_t firstExpected = expectedIndices.size() - expected.size();
+    for(size_t i = 0; i < expected.size(); i++){
+        if(expectedIndices[firstExpected + i] >= since && expectedIndices[firstExpected + i] < scanned)
+            expectedInRange.push_back(expected[i]);
+    }
+    if(res.size() == expectedInRange.size() && checkRes(expectedInRange, res))
+        cout << "Result is correct!" << endl;
+    else
+        cout << "Overflow" << endl;
+
+    // the same range without stored partials: range-restricted detection with indices relative to the range start
+    time_start = chrono::high_resolution_clock::now();
+    DigestAccumulator range(false, since, since);
+    serverOperationsAppend(range, int(scanned - since), switchingKeyCache, switchingKeyPacked, relin_keys, gal_keys_next, gal_keys_last, gal_keys_packed, public_key,
+                        poly_modulus_degree, context, context_next, context_last, context_packed, params);
+    range.digest(lhs, rhs, context);
+    while(context.last_parms_id() != rhs.parms_id()){
+            evaluator.mod_switch_to_next_inplace(rhs);
+            for(size_t k = 0; k < lhs.size(); k++)
+                evaluator.mod_switch_to_next_inplace(lhs[k]);
+        }
+    time_end = chrono::high_resolution_clock::now();
+    time_diff = chrono::duration_cast<chrono::microseconds>(time_end - time_start);
+    cout << "\nRange-restricted detection of [" << since << ", " << scanned << "): " << time_diff.count() << "us." << "\n";
+
+    res = receiverDecoding(lhs, rhs, poly_modulus_degree, secret_key, context, int(scanned - since), seed_glb, int(since));
+    if(res.size() == expectedInRange.size() && checkRes(expectedInRange, res))
+        cout << "Result is correct!" << endl;
+    else
+        cout << "Overflow" << endl;
+}
+
+/**
+ * 持续摄取的检测守护进程 - Continuous ingestion detection daemon
+ * 后台线程中的DetectionDaemon监视公告板日志，而主线程按不均匀的步长发布消息；最后接收者连接，只需等待尚未处理的尾部
+ * A DetectionDaemon on a background thread watches the board log while the main thread publishes messages in uneven steps;
+ * the recipient then connects and only waits for the tail that has not been processed yet
+ */
+void OMR2Daemon(){
+
+    int numOfTransactions = numOfTransactions_glb;
+    createDatabase(numOfTransactions, 306); 
+    cout << "Finishing createDatabase\n";
+
+    // step 1. generate PVW sk 
+    // recipient side
+    auto params = PVWParam(450, 65537, 1.3, 16000, 4); 
+    auto sk = PVWGenerateSecretKey(params);
+    auto pk = PVWGeneratePublicKey(params, sk);
+    cout << "Finishing generating sk for PVW cts\n";
+
+    // step 2. prepare transactions, nothing is published to the log yet
+    auto expected = preparinngTransactionsFormal(pk, numOfTransactions, num_of_pertinent_msgs_glb,  params);
+    publishLogLength(0);
+    cout << expected.size() << " pertinent msg: Finishing preparing messages\n";
+
+    // step 3. generate detection key
+    // recipient side
+    auto profile = selectParamProfile(num_of_pertinent_msgs_glb, 306, true, params);
+    size_t poly_modulus_degree = profile.poly_modulus_degree;
+    EncryptionParameters parms = profileEncryptionParameters(profile);
+
+    SEALContext context(parms, true, sec_level_type::none);
+    print_parameters(context); 
+    KeyGenerator keygen(context);
+    SecretKey secret_key = keygen.secret_key();
+    Evaluator evaluator(context);
+
+    // the recipient uploads its detection key in seeded form, the daemon expands it at the first batch
+    SEALContext context_next = levelSpecificContext(parms, profile.next_primes);
+    SEALContext context_last = levelSpecificContext(parms, profile.last_primes);
+    SEALContext context_packed = levelSpecificContext(parms, rangeCheckOutputPrimes(profile));
+    stringstream upload;
+    auto uploadSize = generateDetectionKey(upload, context, context_next, context_last, context_packed, secret_key, sk, params);
+    unique_ptr<LazyDetectionKey> detectionKey(new LazyDetectionKey(context, context_next, context_last, context_packed, params));
+    if(!detectionKey->load(upload))
+        return;
+    upload.str("");
+    cout << "Finishing generating detection keys, " << uploadSize << " bytes uploaded\n";
+
+    // step 4. detector operations: the daemon detects as batches fill, partial batches are flushed after 2 seconds
+    chrono::high_resolution_clock::time_point time_start, time_end;
+    chrono::microseconds time_diff;
+
+    DetectionDaemon daemon(context, context_next, context_last, context_packed, params, poly_modulus_degree, chrono::seconds(2),
+                        chrono::milliseconds(100));
+    int id = daemon.registerRecipient(move(detectionKey));
+    atomic<bool> stop(false);
+    thread daemonThread([&daemon, &stop](){ daemon.run(stop); });
+
+    // messages are posted over time, 3/4 of a batch per second
+    time_start = chrono::high_resolution_clock::now();
+    for(int posted = 0; posted < numOfTransactions;){
+        posted = min(numOfTransactions, posted + int(poly_modulus_degree*3/4));
+        publishLogLength(posted);
+        this_thread::sleep_for(chrono::seconds(1));
+    }
+    time_end = chrono::high_resolution_clock::now();
+    time_diff = chrono::duration_cast<chrono::microseconds>(time_end - time_start);
+    cout << "\nPosted " << numOfTransactions << " messages in " << time_diff.count() << "us, "
+         << daemon.numOfMessages() << " of them processed by the daemon." << "\n";
+
+    // the recipient connects: process the tail right away
+    time_start = chrono::high_resolution_clock::now();
+    daemon.flush();
+    // wait for this recipient's accumulator, not the daemon's scan position: a recipient whose append failed lags behind it
+    // a recipient that keeps failing never catches up, so give up after a generous bound per batch of the board
+    auto deadline = chrono::steady_clock::now() + chrono::minutes(10) * ((numOfTransactions + poly_modulus_degree - 1)/poly_modulus_degree);
+    DigestAccumulator accumulator;
+    while(daemon.snapshot(id, accumulator) && accumulator.numOfMessages() < size_t(numOfTransactions)
+          && chrono::steady_clock::now() < deadline){
+        this_thread::sleep_for(chrono::milliseconds(100));
+    }
+    stop = true;
+    daemonThread.join();
+    if(accumulator.numOfMessages() != size_t(numOfTransactions)){
+        cerr << "Recipient " << id << " only reached message " << accumulator.numOfMessages() << " of " << numOfTransactions
+             << " before the deadline, the daemon scanned " << daemon.numOfMessages() << "." << endl;
+        return;
+    }
+
+    vector<Ciphertext> lhs;
+    Ciphertext rhs;
+    accumulator.digest(lhs, rhs, context);
+    while(context.last_parms_id() != rhs.parms_id()){
+            evaluator.mod_switch_to_next_inplace(rhs);
+            for(size_t k = 0; k < lhs.size(); k++)
+                evaluator.mod_switch_to_next_inplace(lhs[k]);
+        }
+    time_end = chrono::high_resolution_clock::now();
+    time_diff = chrono::duration_cast<chrono::microseconds>(time_end - time_start);
+    cout << "Detector time after the recipient connects: " << time_diff.count() << "us." << "\n";
+
+    // step 5. receiver decoding
+    time_start = chrono::high_resolution_clock::now();
+    auto res = receiverDecoding(lhs, rhs, poly_modulus_degree, secret_key, context, numOfTransactions, seed_glb);
+    time_end = chrono::high_resolution_clock::now();
+    time_diff = chrono::duration_cast<chrono::microseconds>(time_end - time_start);
+    cout << "\nRecipient runnimg time: " << time_diff.count() << "us." << "\n";
+
+    if(checkRes(expected, res))
+        cout << "Result is correct!" << endl;
+    else
+        cout << "Overflow" << endl;
+}
+
+/**
+ * 载荷检索内核基准测试 - Benchmark of the payload retrieval kernels
+ * 比较稠密路径、稀疏路径与融合内核，并检查结果一致 - Compares the dense path, the sparse path and the fused kernel, and checks they agree
+ * SIC直接以扩展后的层级加密，因此只测量载荷检索本身 - SICs are encrypted directly at the expanded level, so only payload retrieval is measured
+ */
+void payloadRetrievalBenchmark(){
+    int numOfTransactions = 1024;
+    int step = 32;
+
+    auto profile = selectParamProfile(num_of_pertinent_msgs_glb, 306, true, PVWParam(450, 65537, 1.3, 16000, 4), false);
+    size_t poly_modulus_degree = profile.poly_modulus_degree;
+    EncryptionParameters parms = profileEncryptionParameters(profile);
+
+    SEALContext context(parms, true, sec_level_type::none);
+    print_parameters(context);
+    KeyGenerator keygen(context);
+    SecretKey secret_key = keygen.secret_key();
+    PublicKey public_key;
+    keygen.create_public_key(public_key);
+    Encryptor encryptor(context, public_key);
+    Evaluator evaluator(context);
+    Decryptor decryptor(context, secret_key);
+    BatchEncoder batch_encoder(context);
+
+    // the expanded SICs live at the level with 2 primes left, same as context_last in OMR2()
+    auto sic_context_data = context.first_context_data();
+    while(sic_context_data->parms().coeff_modulus().size() > 2){
+        sic_context_data = sic_context_data->next_context_data();
+    }
+
+    srand(time(NULL));
+    vector<Ciphertext> SIC(numOfTransactions);
+    for(int i = 0; i < numOfTransactions; i++){
+        vector<uint64_t> pod_matrix(poly_modulus_degree, uint64_t(rand()%2));
+        Plaintext plain_matrix;
+        batch_encoder.encode(pod_matrix, plain_matrix);
+        encryptor.encrypt(plain_matrix, SIC[i]);
+        evaluator.mod_switch_to_inplace(SIC[i], sic_context_data->parms_id());
+        evaluator.transform_to_ntt_inplace(SIC[i]);
+    }
+    vector<vector<uint64_t>> payload(numOfTransactions, vector<uint64_t>(306));
+    for(int i = 0; i < numOfTransactions; i++){
+        for(size_t j = 0; j < payload[i].size(); j++){
+            payload[i][j] = rand()%65537;
+        }
+    }
+    bipartiteGraphWeightsGeneration(bipartite_map_glb, weights_glb, numOfTransactions,OMRtwoM,repeatition_glb,seed_glb);
+
+    chrono::high_resolution_clock::time_point time_start, time_end;
+    vector<Ciphertext> rhs(3);
+    Ciphertext lhs;
+    vector<long long> time_diff(3);
+    for(int method = 0; method < 3; method++){
+        time_start = chrono::high_resolution_clock::now();
+        for(int i = 0; i < numOfTransactions; i += step){
+            vector<Ciphertext> batch(SIC.begin() + i, SIC.begin() + i + step);
+            if(method == 2){
+                fusedIndexPayloadRetrieval(lhs, rhs[method], batch, payload, bipartite_map_glb, weights_glb, context, poly_modulus_degree, i, i);
+                continue;
+            }
+            vector<vector<Ciphertext>> payloadUnpacked;
+            if(method == 0)
+                payloadRetrievalOptimizedwithWeights(payloadUnpacked, payload, bipartite_map_glb, weights_glb, batch, context, poly_modulus_degree, i, i);
+            else
+                payloadRetrievalSparseWithWeights(payloadUnpacked, payload, bipartite_map_glb, weights_glb, batch, context, poly_modulus_degree, i, i);
+            payloadPackingOptimized(rhs[method], payloadUnpacked, bipartite_map_glb, poly_modulus_degree, context, gal_keys_next, i);
+        }
+        time_end = chrono::high_resolution_clock::now();
+        time_diff[method] = chrono::duration_cast<chrono::microseconds>(time_end - time_start).count();
+    }
+
+    cout << "Dense payload retrieval: " << time_diff[0]/numOfTransactions << "us/msg." << "\n";
+    cout << "Sparse payload retrieval: " << time_diff[1]/numOfTransactions << "us/msg." << "\n";
+    cout << "Fused index and payload retrieval: " << time_diff[2]/numOfTransactions << "us/msg." << "\n";
+
+    vector<vector<uint64_t>> decoded(3, vector<uint64_t>(poly_modulus_degree));
+    for(int method = 0; method < 3; method++){
+        evaluator.transform_from_ntt_inplace(rhs[method]);
+        Plaintext plain_result;
+        decryptor.decrypt(rhs[method], plain_result);
+        batch_encoder.decode(plain_result, decoded[method]);
+    }
+    if(decoded[0] == decoded[1] && decoded[0] == decoded[2])
+        cout << "Result is correct!" << endl;
+    else
+        cout << "Payload digests of the kernels differ" << endl;
+}
+
+void packedRangeCheckBenchmark(){
+    auto params = PVWParam(450, 65537, 1.3, 16000, 4);
+    auto sk = PVWGenerateSecretKey(params);
+    auto pk = PVWGeneratePublicKey(params, sk);
+
+    auto profile = selectParamProfile(num_of_pertinent_msgs_glb, 306, true, params, false);
+    size_t poly_modulus_degree = profile.poly_modulus_degree;
+    EncryptionParameters parms = profileEncryptionParameters(profile);
+
+    // a partial batch that fits into the packed-components layout
+    int numOfClues = int(poly_modulus_degree/params.ell)/2;
+
+    SEALContext context(parms, true, sec_level_type::none);
+    print_parameters(context);
+    KeyGenerator keygen(context);
+    SecretKey secret_key = keygen.secret_key();
+    PublicKey public_key;
+    keygen.create_public_key(public_key);
+    RelinKeys relin_keys;
+    keygen.create_relin_keys(relin_keys);
+    Decryptor decryptor(context, secret_key);
+    BatchEncoder batch_encoder(context);
+
+    vector<Ciphertext> switchingKey(params.ell);
+    genSwitchingKeyPVWPacked(switchingKey, context, poly_modulus_degree, public_key, secret_key, sk, params);
+    Ciphertext switchingKeyPacked;
+    genSwitchingKeyPVWPackedComponents(switchingKeyPacked, context, poly_modulus_degree, public_key, secret_key, sk, params);
+
+    GaloisKeys gal_keys;
+    vector<int> stepsfirst = {1};
+    keygen.create_galois_keys(stepsfirst, gal_keys);
+
+    SEALContext context_packed = levelSpecificContext(parms, rangeCheckOutputPrimes(profile));
+    KeyGenerator keygen_packed(context_packed, levelSpecificSecretKey(secret_key, context, context_packed));
+    GaloisKeys gal_keys_packed;
+    keygen_packed.create_galois_keys(packedComponentsRotationSteps(poly_modulus_degree, params), gal_keys_packed);
+
+    srand(time(NULL));
+    vector<int> zeros(params.ell, 0);
+    PVWBatchEncryptor encryptor(pk, params);
+    vector<PVWCiphertext> SICPVW(numOfClues);
+    for(int i = 0; i < numOfClues; i++){
+        if(rand()%16 == 0){
+            encryptor.encrypt(SICPVW[i], zeros);
+        } else {
+            FlatPVWCiphertext flatclue;
+            FlatPVWEncSK(flatclue, zeros, FlatPVWGenerateSecretKey(params), params);
+            SICPVW[i] = fromFlatPVWCiphertext(flatclue, params);
+        }
+    }
+
+    chrono::high_resolution_clock::time_point time_start, time_end;
+    vector<Ciphertext> packedSIC(2);
+    vector<long long> time_diff(2);
+
+    time_start = chrono::high_resolution_clock::now();
+    packedSIC[0] = serverOperations1obtainPackedSIC(SICPVW, switchingKey, relin_keys, gal_keys, poly_modulus_degree, context, params, numOfClues);
+    time_end = chrono::high_resolution_clock::now();
+    time_diff[0] = chrono::duration_cast<chrono::microseconds>(time_end - time_start).count();
+
+    time_start = chrono::high_resolution_clock::now();
+    packedSIC[1] = serverOperations1obtainPackedSICPackedComponents(SICPVW, switchingKeyPacked, relin_keys, gal_keys, gal_keys_packed,
+                                                                    poly_modulus_degree, context, context_packed, params);
+    time_end = chrono::high_resolution_clock::now();
+    time_diff[1] = chrono::duration_cast<chrono::microseconds>(time_end - time_start).count();
+
+    cout << "Phase 1 with " << params.ell << " range checks: " << time_diff[0] << "us for " << numOfClues << " clues." << "\n";
+    cout << "Phase 1 with packed components: " << time_diff[1] << "us for " << numOfClues << " clues." << "\n";
+
+    vector<vector<uint64_t>> decoded(2, vector<uint64_t>(poly_modulus_degree));
+    for(int method = 0; method < 2; method++){
+        Plaintext plain_result;
+        decryptor.decrypt(packedSIC[method], plain_result);
+        batch_encoder.decode(plain_result, decoded[method]);
+    }
+    if(equal(decoded[0].begin(), decoded[0].begin() + numOfClues, decoded[1].begin()))
+        cout << "Result is correct!" << endl;
+    else
+        cout << "Packed SICs of the two layouts differ" << endl;
+}
+
+/**
+ * 线索预计算池基准 - Clue pool benchmark
+ * 比较发送时直接加密与从后台填充的子集和池中取出线索的延迟，并检查线索能被正确解密
+ * Compares the send-time latency of encrypting directly with popping a clue from the background-filled pool of subset sums,
+ * and checks that the clues decrypt correctly
+ * 公钥以种子化的紧凑格式发布，发送者映射文件，加密器和池直接读取映射的行 - The public key is published in the seeded compact format,
+ * the sender maps the file, and the encryptor and the pool read the mapped rows directly
+ */
+void cluePoolBenchmark(){
+    int numOfClues = 100;
+    auto params = PVWParam(450, 65537, 1.3, 16000, 4);
+    auto flatsk = FlatPVWGenerateSecretKey(params);
+
+    // recipient side: publish the key
+    auto flatpk = FlatPVWGeneratePublicKeySeeded(params, flatsk);
+    ofstream pkFile("../data/pvw_pk.bin", ios::binary);
+    stringstream packedStream;
+    FlatPVWpk unseeded = flatpk;
+    unseeded.seeded = false;
+    cout << "PVW public key: " << size_t(params.m) * (params.n + params.ell) * sizeof(uint64_t) << " bytes as NativeVector, "
+         << saveFlatPVWpk(unseeded, params, packedStream) << " bytes packed, "
+         << saveFlatPVWpk(flatpk, params, pkFile) << " bytes seeded." << endl;
+    pkFile.close();
+
+    // sender side: map the key file, nothing is expanded up front
+    FlatPVWpkMap pkMap("../data/pvw_pk.bin");
+    if(!pkMap.matches(params)){
+        cerr << "The mapped PVW public key does not match the parameters." << endl;
+        return;
+    }
+
+    vector<vector<int>> msgs(numOfClues, vector<int>(params.ell));
+    for(int i = 0; i < numOfClues; i++)
+        for(int j = 0; j < params.ell; j++)
+            msgs[i][j] = rand() % 2;
+
+    // direct: every clue is a pass over the mapped rows at send time
+    FlatPVWBatchEncryptor encryptor(pkMap, params);
+    vector<FlatPVWCiphertext> direct(numOfClues);
+    auto time_start = chrono::high_resolution_clock::now();
+    for(int i = 0; i < numOfClues; i++){
+        vector<FlatPVWCiphertext> one;
+        encryptor.encrypt(one, vector<vector<int>>(1, msgs[i]));
+        direct[i] = move(one[0]);
+    }
+    auto time_end = chrono::high_resolution_clock::now();
+    auto directTime = chrono::duration_cast<chrono::microseconds>(time_end - time_start).count();
+
+    // offline: the wallet fills the pool from the mapped rows in the background, here until it holds all clues
+    FlatPVWCluePool pool(pkMap, params, numOfClues);
+    while(pool.size() < size_t(numOfClues)){
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    // online: one pop and ell additions per clue
+    vector<FlatPVWCiphertext> pooled(numOfClues);
+    time_start = chrono::high_resolution_clock::now();
+    for(int i = 0; i < numOfClues; i++){
+        pool.pop(pooled[i], msgs[i]);
+    }
+    time_end = chrono::high_resolution_clock::now();
+    auto pooledTime = chrono::duration_cast<chrono::microseconds>(time_end - time_start).count();
+
+    cout << "Direct encryption from the mapped key: " << double(directTime)/numOfClues << "us per clue." << endl;
+    cout << "Clue pool: " << double(pooledTime)/numOfClues << "us per clue." << endl;
+
+    int wrong = 0;
+    for(int i = 0; i < numOfClues; i++){
+        vector<int> decrypted;
+        FlatPVWDec(decrypted, direct[i], flatsk, params);
+        wrong += decrypted != msgs[i];
+        FlatPVWDec(decrypted, pooled[i], flatsk, params);
+        wrong += decrypted != msgs[i];
+    }
+    if(!wrong)
+        cout << "Result is correct!" << endl;
+    else
+        cout << wrong << " clue(s) decrypt wrongly" << endl;
+}
+
+/**
+ * 批量接收者解码基准 - Batch recipient decoding benchmark
+ * 为多个用户在接收者上下文中直接加密合成摘要（确定性索引包和按桶加权的载荷），然后比较逐个解码和批量解码
+ * Encrypts synthetic digests (deterministic index packs and per-bucket weighted payloads) for many users directly in the recipient
+ * context, then compares decoding them one by one with the batch decoder
+ */
+void batchRecipientDecodingBenchmark(){
+    int numOfUsers = 64;
+    int numOfTransactions = numOfTransactions_glb;
+    int payloadSize = 306;
+    int threads = max(1, int(thread::hardware_concurrency()));
+    NTL::SetNumThreads(threads);
+
+    auto profile = selectParamProfile(num_of_pertinent_msgs_glb, payloadSize, true, PVWParam(450, 65537, 1.3, 16000, 4), false);
+    size_t poly_modulus_degree = profile.poly_modulus_degree;
+    EncryptionParameters parms = profileEncryptionParameters(profile);
+    SEALContext context = recipientContext(parms, 1);
+    print_parameters(context);
+    BatchEncoder batch_encoder(context);
+
+    srand(time(NULL));
+    int blockSize = int(16*poly_modulus_degree);
+    vector<SecretKey> secret_keys(numOfUsers);
+    vector<RecipientDigest> digests(numOfUsers);
+    vector<vector<vector<uint64_t>>> expected(numOfUsers);
+    for(int u = 0; u < numOfUsers; u++){
+        KeyGenerator keygen(context);
+        secret_keys[u] = keygen.secret_key();
+        Encryptor encryptor(context, secret_keys[u]);
+
+        RecipientDigest& digest = digests[u];
+        digest.numOfTransactions = numOfTransactions;
+        digest.num_of_buckets = OMRtwoM;
+        digest.repetition = repeatition_glb;
+        digest.seed = seed_glb;
+        digest.payloadSize = payloadSize;
+
+        vector<vector<uint64_t>> indexPacks((numOfTransactions + blockSize - 1) / blockSize, vector<uint64_t>(poly_modulus_degree, 0));
+        vector<uint64_t> packedPayloads(poly_modulus_degree, 0);
+        vector<int> buckets, weights;
+        for(size_t i = 0; i < num_of_pertinent_msgs_glb; i++){
+            int index = rand() % numOfTransactions;
+            int local = index % blockSize;
+            if(indexPacks[index / blockSize][local / 16] & (uint64_t(1) << (local % 16)))
+                continue;
+            indexPacks[index / blockSize][local / 16] |= uint64_t(1) << (local % 16);
+
+            vector<uint64_t> payload(payloadSize + 1);
+            payload[0] = uint64_t(index);
+            bucketsOf(buckets, weights, uint64_t(index), OMRtwoM, repeatition_glb, seed_glb);
+            for(int j = 0; j < payloadSize; j++){
+                payload[j+1] = rand() % 65537;
+                for(size_t b = 0; b < buckets.size(); b++){
+                    uint64_t& slot = packedPayloads[buckets[b]*payloadSize + j];
+                    slot = (slot + uint64_t(weights[b]) * payload[j+1]) % 65537;
+                }
+            }
+            expected[u].push_back(payload);
+        }
+
+        Plaintext plain;
+        digest.lhs.resize(indexPacks.size());
+        for(size_t k = 0; k < indexPacks.size(); k++){
+            batch_encoder.encode(indexPacks[k], plain);
+            encryptor.encrypt_symmetric(plain, digest.lhs[k]);
+        }
+        batch_encoder.encode(packedPayloads, plain);
+        encryptor.encrypt_symmetric(plain, digest.rhs);
+    }
+    cout << "Finishing encrypting " << numOfUsers << " digests\n";
+
+    chrono::high_resolution_clock::time_point time_start, time_end;
+    time_start = chrono::high_resolution_clock::now();
+    map<int, int> pertinentIndices;
+    for(int u = 0; u < numOfUsers; u++){
+        recipientDecode(pertinentIndices, digests[u], secret_keys[u], context);
+    }
+    time_end = chrono::high_resolution_clock::now();
+    double serialSeconds = chrono::duration<double>(time_end - time_start).count();
+    cout << "One by one: " << numOfUsers / serialSeconds << " digests/s." << "\n";
+
+    BatchRecipientDecoder decoder(context);
+    vector<vector<vector<long>>> results;
+    vector<map<int, int>> pertinentIndicesPerUser;
+    size_t numOfDecoded = decoder.decode(results, pertinentIndicesPerUser, secret_keys, digests, threads);
+    cout << "Batch decoder with " << threads << " threads: " << decoder.digestsPerSecond() << " digests/s." << "\n";
+
+    // 解按相关索引的顺序编号，补上索引后与checkRes比较 - Solutions are numbered in the order of the pertinent indices, prepend the index for checkRes
+    bool correct = numOfDecoded == size_t(numOfUsers);
+    for(int u = 0; u < numOfUsers && correct; u++){
+        for(auto it = pertinentIndicesPerUser[u].begin(); it != pertinentIndicesPerUser[u].end(); it++){
+            results[u][it->second].insert(results[u][it->second].begin(), long(it->first));
+        }
+        correct = checkRes(expected[u], results[u]);
+    }
+    if(correct)
+        cout << "Result is correct!" << endl;
+    else
+        cout << "Batch decoding differs from the expected payloads" << endl;
+}
 
 int main(){
 
@@ -1132,18 +1952,25 @@ int main(){
     cout << "| 7. OMR2p Two Threads               |" << endl;
     cout << "| 8. OMR1p Four Threads              |" << endl;
     cout << "| 9. OMR2p Four Threads              |" << endl;
+    cout << "| 10. Payload Retrieval Benchmark    |" << endl;
+    cout << "| 11. Packed Range Check Benchmark   |" << endl;
+    cout << "| 12. OMR1p Streaming Updates        |" << endl;
+    cout << "| 13. OMR1p Range Queries            |" << endl;
+    cout << "| 14. OMR1p Ingestion Daemon         |" << endl;
+    cout << "| 15. Batch Recipient Decoding       |" << endl;
+    cout << "| 16. Clue Pool (Offline/Online)     |" << endl;
     cout << "+------------------------------------+" << endl;
 
     int selection = 0;
     bool valid = true;
     do
     {
-        cout << endl << "> Run demos (1 ~ 9) or exit (0): ";
+        cout << endl << "> Run demos (1 ~ 16) or exit (0): ";
         if (!(cin >> selection))
         {
             valid = false;
         }
-        else if (selection < 0 || selection > 9)
+        else if (selection < 0 || selection > 16)
         {
             valid = false;
         }
@@ -1153,7 +1980,7 @@ int main(){
         }
         if (!valid)
         {
-            cout << "  [Beep~~] valid option: type 0 ~ 9" << endl;
+            cout << "  [Beep~~] valid option: type 0 ~ 16" << endl;
             cin.clear();
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
         }
@@ -1204,6 +2031,34 @@ int main(){
             OMR3();
             break;
 
+        case 10:
+            payloadRetrievalBenchmark();
+            break;
+
+        case 11:
+            packedRangeCheckBenchmark();
+            break;
+
+        case 12:
+            OMR2Streaming();
+            break;
+
+        case 13:
+            OMR2EpochQueries();
+            break;
+
+        case 14:
+            OMR2Daemon();
+            break;
+
+        case 15:
+            batchRecipientDecodingBenchmark();
+            break;
+
+        case 16:
+            cluePoolBenchmark();
+            break;
+
         case 0:
             return 0;
         }
@@ -0,0 +1,59 @@
+// 包含必要的头文件 - Include necessary header files
+#include "include/RecipientDecoding.h" // 轻量的接收者解码 - Lightweight recipient decoding
+#include <NTL/BasicThreadPool.h>      // NTL线程池 - NTL thread pool
+#include <chrono>                     // 计时 - Timing
+#include <fstream>                    // 文件流 - File streams
+#include <string>                     // 字符串 - Strings
+
+using namespace seal;
+
+/**
+ * 独立的接收者程序 - Standalone recipient program
+ * 用法 - Usage: OMRrecipient [参数文件 - parms file] [私钥文件 - secret key file] [摘要文件 - digest file] [线程数 - threads]
+ * 默认读取OMRdemos的OMR演示写入的../data/recipient_*.bin - Reads ../data/recipient_*.bin written by the OMR demos of OMRdemos by default
+ * 只构建摘要所在级别的上下文，不链接检测者的任何状态 - Only builds the context of the digest's level and links none of the detector's state
+ */
+int main(int argc, char** argv){
+    string parmsPath = argc > 1 ? argv[1] : "../data/recipient_parms.bin";
+    string skPath = argc > 2 ? argv[2] : "../data/recipient_sk.bin";
+    string digestPath = argc > 3 ? argv[3] : "../data/recipient_digest.bin";
+    int threads = argc > 4 ? stoi(argv[4]) : 1;
+    NTL::SetNumThreads(threads);
+
+    auto time_start = chrono::high_resolution_clock::now();
+
+    // 1. 接收者上下文和私钥 - Recipient context and secret key
+    ifstream parmsFile(parmsPath, ios::binary);
+    ifstream skFile(skPath, ios::binary);
+    ifstream digestFile(digestPath, ios::binary);
+    if(!parmsFile || !skFile || !digestFile){
+        cerr << "Cannot open " << parmsPath << ", " << skPath << " or " << digestPath << "." << endl;
+        return 1;
+    }
+    EncryptionParameters parms(scheme_type::bfv);
+    parms.load(parmsFile);
+    SEALContext context(parms, false, sec_level_type::none);
+    SecretKey secret_key;
+    secret_key.load(context, skFile);
+
+    // 2. 摘要 - Digest
+    RecipientDigest digest;
+    if(!loadRecipientDigest(digest, context, digestFile))
+        return 1;
+
+    // 3. 解码 - Decoding
+    map<int, int> pertinentIndices;
+    auto res = recipientDecode(pertinentIndices, digest, secret_key, context, threads);
+
+    auto time_end = chrono::high_resolution_clock::now();
+    auto time_diff = chrono::duration_cast<chrono::microseconds>(time_end - time_start);
+
+    for(auto it = pertinentIndices.begin(); it != pertinentIndices.end(); it++){
+        cout << it->first << " ";
+    }
+    cout << endl;
+    cout << "Decoded " << res.size() << " payload(s) of " << digest.numOfTransactions << " messages." << endl;
+    cout << "Recipient runnimg time: " << time_diff.count() << "us." << endl;
+    cout << "Peak RSS: " << peakRSSKilobytes() << " KB" << endl;
+    return res.size() == pertinentIndices.size() ? 0 : 1;
+}